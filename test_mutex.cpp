@@ -3,25 +3,153 @@
 //    test_mutex benaphore 4   # run test_mutex with libdispatch benaphore, 4 threads
 //    test_mutex mutex 2       # run test_mutex with pthreads mutex, 2 threads
 //    test_mutex mutex2 8      # run test_mutex with hybrid mutex, 8 threads
+//    test_mutex mutex2_backoff 8 pause_spins=100 max_backoff=64 yield_spins=5000
+//                             # run test_mutex with hybrid mutex spinning on pause with exponential backoff
+//                             # before sched_yield and the semaphore, 8 threads (values shown are the defaults)
+//    test_mutex mutex2_ttas 8 # run test_mutex with hybrid mutex spinning on a load before each CAS, 8 threads;
+//                             # reports CAS attempts per acquisition (mutex2_counted is the plain mutex2 equivalent)
+//    test_mutex mutex_adaptive 8
+//                             # run test_mutex with a lock that spins only while nobody is parked and the
+//                             # owner is on a CPU, 8 threads
+//    test_mutex counter_rseq 8
+//                             # increment a per-CPU counter with restartable sequences instead of taking a
+//                             # lock, 8 threads (counter_sharded uses atomics on per-CPU shards instead)
+//    test_mutex freelist_rseq 8
+//                             # pop and push nodes of a per-CPU freelist with restartable sequences, 8 threads
+//                             # (freelist_sharded uses CAS on per-CPU lists instead)
+//    test_mutex stamped 8 write_pct=10
+//                             # read a pair of values with optimistic reads of a stamped lock and write them
+//                             # under its write lock 10% of the time, 8 threads; reports failed validations
+//    test_mutex barrier_dissemination 8 increments=100000 pin=1
+//                             # 100000 episodes of a dissemination barrier across 8 threads pinned to CPUs
+//                             # (also barrier_central, barrier_tournament and barrier_pthread)
+//    test_mutex notify_eventcount 4 increments=100000
+//                             # cost of posting to an eventcount with nobody waiting, then hand-off latency
+//                             # around a ring of 4 threads blocked on eventcounts (notify_sem uses sem_t)
+//    test_mutex hemlock 8     # run test_mutex with Hemlock, a queue lock taking a word per lock and per thread,
+//                             # 8 threads (clh is a CLH lock with one word nodes); reports the memory used
+//    test_mutex shuffle 8 sockets=2
+//                             # run test_mutex with a queue lock whose head waiter moves waiters from its socket up
+//                             # the queue, on 2 simulated sockets, 8 threads (mcs is the plain MCS lock)
+//    test_mutex hbo 8 sockets=2 local_backoff=16 remote_backoff=1024 max_local=64
+//                             # run test_mutex with a hierarchical backoff lock, where threads on the owner's socket
+//                             # back off less, on 2 simulated sockets, 8 threads (values shown are the defaults);
+//                             # max_local bounds the acquisitions in a row on one socket (also for shuffle, 0 for
+//                             # no limit)
+//    test_mutex futex_lock 8  # run test_mutex with a lock straight on a private futex, 8 threads
+//                             # (futex_lock_shared leaves out FUTEX_PRIVATE_FLAG)
+//    test_mutex shards_waitv 8 shards=4
+//                             # each operation locks whichever of 4 futex locks is free, waiting on all of them
+//                             # with futex_waitv when none is, 8 threads (shards_futex waits on one shard instead)
+//    test_mutex payload_mutex2 4 increments=1000000
+//                             # update payloads of 8 to 256 bytes under a hybrid mutex, once embedded next to the lock
+//                             # word in a locked<T, Mutex> and once on cache lines of their own, 4 threads (also
+//                             # payload_mutex, payload_benaphore, payload_futex_lock and payload_hemlock)
+//    test_mutex inversion_pi_mutex 4 rounds=100 hold=100
+//                             # a high priority thread times 100 acquisitions of a priority inheritance mutex that a
+//                             # low priority thread keeps holding for 100us, with 2 medium priority threads spinning
+//                             # on the same CPU (also inversion_mutex, inversion_benaphore and inversion_mutex2)
+//    test_mutex plugin 4 plugin=./my_lock.so
+//                             # run test_mutex with a lock loaded from a shared object (see test_mutex_plugin.h)
+//    test_mutex plugin 4      # run test_mutex with pthreads mutex called through the plugin ABI
+//    test_mutex mutex2 4 mode=trylock
+//                             # each acquisition tries try_lock() first and falls back to lock()
+//    test_mutex benaphore 4 mode=timedlock timeout=20 increments=1000000
+//                             # each acquisition tries try_lock_for(20us) first and falls back to lock()
+//    test_mutex mutex 4 pin=1 # pin thread t to the t'th CPU the process may run on
+//    test_mutex mutex2 4 layout=colocated
+//                             # put the counter on the same cache line as the lock (default separate: each on its
+//                             # own cache line; separate128: each on its own 128 byte pair of lines)
+//    test_mutex mutex2 4 lines=16
+//                             # also read and write every word of a 16 cache line buffer in each critical section;
+//                             # compare lines=0, 1, 4, 16 ... to see how each lock's handoff cost grows with the data
+//                             # the critical section touches (at most 4096)
+//    test_mutex mutex2 4 lines=4096 hugepages=hugetlb
+//                             # back the lock, counter and buffer with a MAP_HUGETLB page (thp: madvise for transparent
+//                             # huge pages; off: regular pages), falling back when none are available, and report
+//                             # dTLB load misses where perf_event_open is allowed
+//    test_mutex mutex2 8 park=futex
+//                             # run test_mutex with hybrid mutex parking on a raw futex instead of sem_t, 8 threads
+//                             # (also cond, eventfd and pipe; for benaphore and mutex2)
+//    test_mutex20 mutex2_atomic 8
+//                             # run test_mutex with hybrid mutex on C++20 atomics, 8 threads (C++20 build only)
+//    test_mutex20 std_mutex 4 # run test_mutex with std::mutex (also std_timed_mutex, std_shared_mutex,
+//                             # std_binary_semaphore and benaphore_std_semaphore), 4 threads (C++20 build only)
+//    test_mutex20 async_mutex 4 coroutines=1000
+//                             # spread the increments of 4 threads over 1000 coroutines run on a pool of 4
+//                             # threads, contending on a coroutine mutex (C++20 build only)
+//    test_mutex20 mutex2 4 tasks=1000
+//                             # run the increments of 4 threads as tasks of up to 1000 increments on a
+//                             # work-stealing pool of 4 workers (C++20 build only)
+//    test_mutex20 deque 4     # push and pop on the work-stealing deque from one thread while 3 others steal
+//                             # from it (C++20 build only)
+//    test_mutex20 benaphore_atomic 4 orders=sar
+//                             # seq_cst increment in lock, acquire/release decrement in unlock,
+//                             # relaxed loads plus fences while parked (letters: s, a, r)
 
 // Compilation:
 //
-//    g++ test_mutex.cpp -o test_mutex -Wall -Wextra -Werror -ansi -pedantic -O3 -lpthread -lrt
+//    g++ test_mutex.cpp -o test_mutex -Wall -Wextra -Werror -ansi -pedantic -O3 -lpthread -lrt -ldl
 //    NOTE: If you get linker errors about the atomic built-in functions (__sync_*),
 //          then add -march=i486 so that they will be included (not available for i386)
 //
 // Add -DDOCHECKS=1 to enable error checking.
+//
+// The same source built as C++20 also gets the std::atomic based locks:
+//
+//    g++ test_mutex.cpp -o test_mutex20 -Wall -Wextra -Werror -std=c++20 -pedantic -O3 -lpthread -lrt -ldl
 
+#include "test_mutex_plugin.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+#include <poll.h>
 #include <semaphore.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <iomanip>
 #include <iostream>
+#include <new>
+#include <string>
 #include <vector>
 
 #include <stdint.h>
 
+// Restartable sequences need glibc's rseq registration (2.35+) and the x86-64 critical sections below
+#if defined(__x86_64__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#   define HAVE_RSEQ 1
+#   include <sys/rseq.h>
+#endif
+
+#if __cplusplus >= 202002L
+#   include <atomic>
+#   include <chrono>
+#   include <condition_variable>
+#   include <coroutine>
+#   include <deque>
+#   include <latch>
+#   include <memory>
+#   include <mutex>
+#   include <semaphore>
+#   include <shared_mutex>
+#   include <string>
+#   include <thread>
+#endif
+
 // Prehistoric error checking for brevity
 #if defined(DOCHECKS)
 #   define CHECK(condition) \
@@ -38,49 +166,531 @@
 #   define CHECK(condition) (void)(condition)
 #endif
 
-class mutex
+double now_seconds()
+{
+    timespec now;
+    CHECK( clock_gettime(CLOCK_MONOTONIC, &now) == 0 );
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Absolute CLOCK_REALTIME deadline as taken by sem_timedwait and pthread_mutex_timedlock
+timespec deadline_after(uint64_t timeout_ns)
+{
+    timespec deadline;
+    CHECK( clock_gettime(CLOCK_REALTIME, &deadline) == 0 );
+    const uint64_t nsec = deadline.tv_nsec + timeout_ns;
+    deadline.tv_sec += nsec / 1000000000;
+    deadline.tv_nsec = nsec % 1000000000;
+    return deadline;
+}
+
+bool expired(const timespec &deadline)
+{
+    timespec now;
+    CHECK( clock_gettime(CLOCK_REALTIME, &now) == 0 );
+    return now.tv_sec > deadline.tv_sec || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+template<typename T>
+T load(const T &value) { return *static_cast<const volatile T *>(&value); }
+
+// try_lock_for for locks that have no timed wait of their own
+template<typename Mutex>
+bool poll_try_lock_for(Mutex &mtx, uint64_t timeout_ns)
+{
+    const timespec deadline = deadline_after(timeout_ns);
+    while (!mtx.try_lock())
+    {
+        if (expired(deadline))
+            return false;
+
+        sched_yield();
+    }
+
+    return true;
+}
+
+// Hint to the CPU that this is a spin-wait loop
+inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Spins on a flag with the pause instruction, yielding the CPU between short bursts
+template<typename T>
+void wait_until_equal(const T &flag, T value)
+{
+    while (load(flag) != value)
+    {
+        for (int spins = 0; spins != 64 && load(flag) != value; ++spins)
+            cpu_relax();
+
+        if (load(flag) != value)
+            sched_yield();
+    }
+}
+
+template<typename T, typename Value>
+void store(T &flag, Value value)
+{
+    __sync_synchronize(); // everything before the store is visible to the threads that see it
+    *static_cast<volatile T *>(&flag) = value;
+}
+
+// Atomically replaces word with value and returns what it held before
+template<typename T>
+T exchange(T &word, T value)
+{
+    for (T current = load(word);;)
+    {
+        const T seen = __sync_val_compare_and_swap(&word, current, value);
+        if (seen == current)
+            return seen;
+        current = seen;
+    }
+}
+
+// Per thread xorshift generator, for jittering backoff and picking operations
+inline uint32_t thread_random()
+{
+    static __thread uint32_t state = 0;
+    if (state == 0)
+        state = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state)) | 1; // differs per thread
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Blocks while *word == expected (or until woken or interrupted). The futex is private to this process unless
+// private_flag is 0, which makes the kernel key it by the underlying page so other processes could share it.
+void futex_wait(uint32_t *word, uint32_t expected, int private_flag = FUTEX_PRIVATE_FLAG)
+{
+    syscall(SYS_futex, word, FUTEX_WAIT | private_flag, expected, 0, 0, 0);
+}
+
+// futex_wait with an absolute CLOCK_REALTIME deadline; returns false once the deadline has passed
+bool futex_wait_until(uint32_t *word, uint32_t expected, const timespec &deadline, int private_flag = FUTEX_PRIVATE_FLAG)
+{
+    return syscall(SYS_futex, word, FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME | private_flag, expected, &deadline, 0, FUTEX_BITSET_MATCH_ANY) == 0 ||
+           errno != ETIMEDOUT;
+}
+
+// Wakes up to count threads blocked in futex_wait on word
+void futex_wake(uint32_t *word, int count, int private_flag = FUTEX_PRIVATE_FLAG)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE | private_flag, count, 0, 0, 0);
+}
+
+pid_t current_tid()
+{
+    static __thread pid_t tid = 0;
+    if (tid == 0)
+        tid = static_cast<pid_t>(syscall(SYS_gettid));
+
+    return tid;
+}
+
+// Whether another thread of this process may be on a CPU right now: /proc/self/task/<tid>/stat says it is
+// runnable and the CPU it last ran on isn't the one the calling thread is running on
+bool thread_on_cpu(pid_t tid)
+{
+    char path[64];
+    std::sprintf(path, "/proc/self/task/%d/stat", static_cast<int>(tid));
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false; // the thread has exited
+
+    char stat[512];
+    const ssize_t length = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (length <= 0)
+        return false;
+
+    stat[length] = '\0';
+    const char *field = std::strrchr(stat, ')'); // "<tid> (<name>) <state> ... <processor> ..."
+    if (field == 0 || field[1] != ' ' || field[2] != 'R')
+        return false;
+
+    for (int skip = 0; skip != 37 && field != 0; ++skip) // state is field 3, processor field 39
+        field = std::strchr(field + 1, ' ');
+
+    return field == 0 || std::atoi(field + 1) != sched_getcpu();
+}
+
+// Sockets for the NUMA aware locks. On a single node machine sockets=N simulates N sockets, with benchmark thread t
+// on socket t % N; otherwise a thread is on the physical package of the CPU it is running on.
+unsigned simulated_sockets = 0;
+__thread unsigned thread_index = 0; // set by the benchmark threads
+
+unsigned cpu_socket(int cpu)
+{
+    static int sockets[CPU_SETSIZE]; // socket + 1, 0 until read
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return 0;
+
+    if (sockets[cpu] == 0)
+    {
+        char path[96];
+        std::sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+
+        int socket = 0;
+        if (std::FILE *file = std::fopen(path, "r"))
+        {
+            if (std::fscanf(file, "%d", &socket) != 1 || socket < 0)
+                socket = 0;
+            std::fclose(file);
+        }
+        sockets[cpu] = socket + 1;
+    }
+
+    return sockets[cpu] - 1;
+}
+
+unsigned current_socket()
+{
+    if (simulated_sockets != 0)
+        return thread_index % simulated_sockets;
+
+    return cpu_socket(sched_getcpu());
+}
+
+// Most acquisitions in a row the NUMA aware locks let one socket make before turning to waiters on other sockets,
+// trading throughput for fairness; 0 for no limit
+uint32_t max_local_handoffs = 64;
+
+uint32_t local_handoff_limit() { return max_local_handoffs != 0 ? max_local_handoffs : UINT32_MAX; }
+
+// Parking backends for the benaphore style locks. Each is a counting semaphore: post() adds a token, wait()
+// blocks until it can take one and wait_until() gives up at a CLOCK_REALTIME deadline, returning false.
+
+class sem_parker
+{
+    public:
+        sem_parker() { CHECK( sem_init(&sema, 0, 0) == 0 ); } // initial count is 0
+        ~sem_parker() { CHECK( sem_destroy(&sema) == 0 ); }
+
+        void post() { CHECK( sem_post(&sema) == 0 ); }
+        void wait() { CHECK( sem_wait(&sema) == 0 ); }
+
+        bool wait_until(const timespec &deadline)
+        {
+            if (sem_timedwait(&sema, &deadline) == 0)
+                return true;
+
+            CHECK( errno == ETIMEDOUT || errno == EINTR );
+            return false;
+        }
+
+        static const char *name() { return "sem"; }
+
+    private:
+        sem_t sema;
+};
+
+// Tokens counted in a futex word, with a FUTEX_WAKE for every post
+class futex_parker
+{
+    public:
+        futex_parker() : tokens(0) { }
+
+        void post()
+        {
+            __sync_fetch_and_add(&tokens, 1);
+            futex_wake(&tokens, 1);
+        }
+
+        void wait()
+        {
+            while (!try_take())
+                futex_wait(&tokens, 0);
+        }
+
+        bool wait_until(const timespec &deadline)
+        {
+            while (!try_take())
+            {
+                if (!futex_wait_until(&tokens, 0, deadline))
+                    return try_take();
+            }
+
+            return true;
+        }
+
+        static const char *name() { return "futex"; }
+
+    private:
+        bool try_take()
+        {
+            for (;;)
+            {
+                const uint32_t current = *static_cast<volatile uint32_t *>(&tokens);
+                if (current == 0)
+                    return false;
+
+                if (__sync_bool_compare_and_swap(&tokens, current, current - 1))
+                    return true;
+            }
+        }
+
+        uint32_t tokens;
+};
+
+class cond_parker
+{
+    public:
+        cond_parker() : tokens(0)
+        {
+            CHECK( pthread_mutex_init(&m, 0) == 0 );
+            CHECK( pthread_cond_init(&cond, 0) == 0 );
+        }
+
+        ~cond_parker()
+        {
+            CHECK( pthread_cond_destroy(&cond) == 0 );
+            CHECK( pthread_mutex_destroy(&m) == 0 );
+        }
+
+        void post()
+        {
+            CHECK( pthread_mutex_lock(&m) == 0 );
+            ++tokens;
+            CHECK( pthread_mutex_unlock(&m) == 0 );
+            CHECK( pthread_cond_signal(&cond) == 0 );
+        }
+
+        void wait()
+        {
+            CHECK( pthread_mutex_lock(&m) == 0 );
+            while (tokens == 0)
+                CHECK( pthread_cond_wait(&cond, &m) == 0 );
+            --tokens;
+            CHECK( pthread_mutex_unlock(&m) == 0 );
+        }
+
+        bool wait_until(const timespec &deadline)
+        {
+            CHECK( pthread_mutex_lock(&m) == 0 );
+            int result = 0;
+            while (tokens == 0 && result != ETIMEDOUT)
+                result = pthread_cond_timedwait(&cond, &m, &deadline);
+
+            const bool taken = tokens != 0;
+            if (taken)
+                --tokens;
+            CHECK( pthread_mutex_unlock(&m) == 0 );
+            return taken;
+        }
+
+        static const char *name() { return "cond"; }
+
+    private:
+        pthread_mutex_t m;
+        pthread_cond_t cond;
+        uint32_t tokens;
+};
+
+// Reads size bytes from the non-blocking fd, polling until it is readable as another thread may take the data first.
+// A null deadline waits forever; otherwise returns false once the CLOCK_REALTIME deadline has passed.
+bool read_when_ready(int fd, void *buffer, size_t size, const timespec *deadline)
+{
+    for (;;)
+    {
+        const ssize_t result = read(fd, buffer, size);
+        if (result == static_cast<ssize_t>(size))
+            return true;
+        CHECK( result < 0 && (errno == EAGAIN || errno == EINTR) );
+
+        pollfd ready = { fd, POLLIN, 0 };
+        if (deadline == 0)
+        {
+            poll(&ready, 1, -1);
+            continue;
+        }
+
+        timespec remaining;
+        CHECK( clock_gettime(CLOCK_REALTIME, &remaining) == 0 );
+        remaining.tv_sec = deadline->tv_sec - remaining.tv_sec;
+        remaining.tv_nsec = deadline->tv_nsec - remaining.tv_nsec;
+        if (remaining.tv_nsec < 0)
+        {
+            remaining.tv_nsec += 1000000000;
+            --remaining.tv_sec;
+        }
+
+        if (remaining.tv_sec < 0)
+            return read(fd, buffer, size) == static_cast<ssize_t>(size);
+
+        ppoll(&ready, 1, &remaining, 0);
+    }
+}
+
+// eventfd in semaphore mode, so every read takes one token
+class eventfd_parker
+{
+    public:
+        eventfd_parker() : fd(eventfd(0, EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC)) { CHECK( fd >= 0 ); }
+        ~eventfd_parker() { CHECK( close(fd) == 0 ); }
+
+        void post()
+        {
+            const uint64_t one = 1;
+            CHECK( write(fd, &one, sizeof(one)) == sizeof(one) );
+        }
+
+        void wait() { take(0); }
+        bool wait_until(const timespec &deadline) { return take(&deadline); }
+
+        static const char *name() { return "eventfd"; }
+
+    private:
+        bool take(const timespec *deadline)
+        {
+            uint64_t token;
+            return read_when_ready(fd, &token, sizeof(token), deadline);
+        }
+
+        int fd;
+};
+
+// One byte in a pipe per token
+class pipe_parker
+{
+    public:
+        pipe_parker() { CHECK( pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0 ); }
+
+        ~pipe_parker()
+        {
+            CHECK( close(fds[0]) == 0 );
+            CHECK( close(fds[1]) == 0 );
+        }
+
+        void post()
+        {
+            const char token = 0;
+            CHECK( write(fds[1], &token, 1) == 1 );
+        }
+
+        void wait() { take(0); }
+        bool wait_until(const timespec &deadline) { return take(&deadline); }
+
+        static const char *name() { return "pipe"; }
+
+    private:
+        bool take(const timespec *deadline)
+        {
+            char token;
+            return read_when_ready(fds[0], &token, 1, deadline);
+        }
+
+        int fds[2]; // read end, write end
+};
+
+// Undo the increment of count made by a benaphore style waiter whose timed wait timed out. If it is the only
+// one left in count then an unlock has already decided to post for it, so that post has to be taken instead.
+template<typename Parker>
+bool stop_waiting(int32_t &count, Parker &parker)
+{
+    for (;;)
+    {
+        const int32_t current = load(count);
+        if (current == 1)
+        {
+            parker.wait();
+            return true;
+        }
+
+        if (__sync_bool_compare_and_swap(&count, current, current - 1))
+            return false;
+    }
+}
+
+// pthreads mutex with the given PTHREAD_PRIO_* protocol
+template<int Protocol>
+class basic_mutex
 {
     public:
-        mutex() { CHECK( pthread_mutex_init(&m, 0) == 0 ); }
-        ~mutex() { CHECK( pthread_mutex_destroy(&m) == 0 ); }
+        basic_mutex()
+        {
+            pthread_mutexattr_t attr;
+            CHECK( pthread_mutexattr_init(&attr) == 0 );
+            CHECK( pthread_mutexattr_setprotocol(&attr, Protocol) == 0 );
+            CHECK( pthread_mutex_init(&m, &attr) == 0 );
+            CHECK( pthread_mutexattr_destroy(&attr) == 0 );
+        }
+
+        ~basic_mutex() { CHECK( pthread_mutex_destroy(&m) == 0 ); }
 
         void lock() { CHECK( pthread_mutex_lock(&m) == 0 ); }
         void unlock() { CHECK( pthread_mutex_unlock(&m) == 0 ); }
+        bool try_lock() { return pthread_mutex_trylock(&m) == 0; }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            return pthread_mutex_timedlock(&m, &deadline) == 0;
+        }
 
     private:
         pthread_mutex_t m;
 };
 
-class benaphore
+typedef basic_mutex<PTHREAD_PRIO_NONE> mutex;
+typedef basic_mutex<PTHREAD_PRIO_INHERIT> pi_mutex; // the owner runs at the priority of its highest priority waiter
+
+// Parker is one of the parking backends above
+template<typename Parker>
+class basic_benaphore
 {
     public:
-        benaphore() : count(0) { CHECK( sem_init(&sema, 0, 0) == 0); } // initial count is 0
-        ~benaphore() { CHECK( sem_destroy(&sema) == 0 ); }
+        basic_benaphore() : count(0) { }
 
         void lock()
         {
             // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
             if (__sync_fetch_and_add(&count, 1) > 0) // if (++count > 1)
-                CHECK( sem_wait(&sema) == 0 ); // wait for unlock
+                sema.wait(); // wait for unlock
         }
 
         void unlock()
         {
             // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
             if (__sync_fetch_and_sub(&count, 1) > 1) // if (--count > 0)
-                CHECK( sem_post(&sema) == 0 ); // release a waiting thread
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock() { return __sync_bool_compare_and_swap(&count, 0, 1); }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            if (__sync_fetch_and_add(&count, 1) == 0) // if (++count == 1)
+                return true;
+
+            if (sema.wait_until(deadline_after(timeout_ns)))
+                return true;
+
+            return stop_waiting(count, sema);
         }
 
     private:
         int32_t count;
-        sem_t sema;
+        Parker sema;
 };
 
-class mutex2
+typedef basic_benaphore<sem_parker> benaphore;
+
+// Parker is one of the parking backends above
+template<typename Parker>
+class basic_mutex2
 {
     public:
-        mutex2() : count(0) { CHECK( sem_init(&sema, 0, 0) == 0); } // initial count is 0
-        ~mutex2() { CHECK( sem_destroy(&sema) == 0 ); }
+        basic_mutex2() : count(0) { }
 
         void lock()
         {
@@ -94,96 +704,4053 @@ class mutex2
 
             // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
             if (__sync_fetch_and_add(&count, 1) > 0) // if (++count > 1)
-                CHECK( sem_wait(&sema) == 0 ); // wait for unlock
+                sema.wait(); // wait for unlock
         }
 
         void unlock()
         {
             // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
             if (__sync_fetch_and_sub(&count, 1) > 1) // if (--count > 0)
-                CHECK( sem_post(&sema) == 0 ); // release a waiting thread
+                sema.post(); // release a waiting thread
         }
 
-    private:
-        int32_t count;
-        sem_t sema;
-};
+        bool try_lock() { return __sync_bool_compare_and_swap(&count, 0, 1); }
 
-template<typename Mutex>
-struct shared_stuff
-{
-    shared_stuff(uint32_t increments) : 
-        increments(increments),
-        total(0) 
-    { 
-    }
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            for (unsigned spins = 0; spins != 5000 && !expired(deadline); ++spins)
+            {
+                if (__sync_bool_compare_and_swap(&count, 0, 1))
+                    return true;
 
-    const uint32_t increments;
+                sched_yield();
+            }
 
-    char cache_line_separation1[64]; // put the mutex on its own cache line
-    Mutex mtx;
-    char cache_line_separation2[64]; // put the mutex on its own cache line
+            if (__sync_fetch_and_add(&count, 1) == 0) // if (++count == 1)
+                return true;
 
-    uint32_t total;
-};
+            if (sema.wait_until(deadline))
+                return true;
 
-template<typename Mutex>
-void *thread_body(void *opaque_arg)
-{
-    CHECK( opaque_arg != 0 );
-    shared_stuff<Mutex> &stuff = *static_cast<shared_stuff<Mutex> *>(opaque_arg);
+            return stop_waiting(count, sema);
+        }
 
-    for (uint32_t i = 0; i != stuff.increments; ++i)
-    {
-        stuff.mtx.lock();
-        ++stuff.total;
-        stuff.mtx.unlock();
-    }
+    private:
+        int32_t count;
+        Parker sema;
+};
 
-    return 0;
-}
+typedef basic_mutex2<sem_parker> mutex2;
 
-template<typename Mutex>
-void test_mutex(unsigned num_threads)
+// mutex2 that escalates through phases: CAS with bounded, jittered exponential backoff on the pause instruction,
+// then CAS with sched_yield, then waiting on the semaphore. The acquisitions resolved in each phase are counted.
+class mutex2_backoff
 {
-    const uint32_t increments = 20 * 1000 * 1000;
+    public:
+        enum phase
+        {
+            phase_immediate,    // first CAS
+            phase_pause,
+            phase_yield,
+            phase_park,
+            phase_count
+        };
 
-    shared_stuff<Mutex> stuff(increments);
+        struct thresholds
+        {
+            unsigned pause_spins;   // CAS attempts with pause backoff between them
+            unsigned max_backoff;   // cap on the pause instructions between two attempts
+            unsigned yield_spins;   // CAS attempts with sched_yield between them
+        };
 
-    std::vector<pthread_t> threads;
-    threads.reserve(num_threads);
+        static thresholds config;
+
+        mutex2_backoff() : count(0) { std::memset(acquisitions, 0, sizeof(acquisitions)); }
+
+        void lock() { acquire(0); }
+
+        void unlock()
+        {
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_sub(&count, 1) > 1) // if (--count > 0)
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock() { return __sync_bool_compare_and_swap(&count, 0, 1); }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            return acquire(&deadline);
+        }
+
+        // Only read once the benchmark threads are done
+        const uint64_t *phase_acquisitions() const { return acquisitions; }
+
+    private:
+        // No deadline waits forever
+        bool acquire(const timespec *deadline)
+        {
+            if (__sync_bool_compare_and_swap(&count, 0, 1))
+                return acquired(phase_immediate);
+
+            unsigned backoff = 1;
+            for (unsigned spins = 0; spins != config.pause_spins && !(deadline && expired(*deadline)); ++spins)
+            {
+                for (uint32_t delay = backoff + thread_random() % backoff; delay != 0; --delay)
+                    cpu_relax();
+
+                if (__sync_bool_compare_and_swap(&count, 0, 1))
+                    return acquired(phase_pause);
+
+                if (backoff < config.max_backoff)
+                    backoff *= 2;
+            }
+
+            for (unsigned spins = 0; spins != config.yield_spins && !(deadline && expired(*deadline)); ++spins)
+            {
+                sched_yield();
+
+                if (__sync_bool_compare_and_swap(&count, 0, 1))
+                    return acquired(phase_yield);
+            }
+
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_add(&count, 1) > 0) // if (++count > 1)
+            {
+                if (deadline == 0)
+                    sema.wait(); // wait for unlock
+                else if (!sema.wait_until(*deadline) && !stop_waiting(count, sema))
+                    return false;
+            }
+
+            return acquired(phase_park);
+        }
+
+        // Called with the lock held, so the counters need no atomics
+        bool acquired(phase resolved)
+        {
+            ++acquisitions[resolved];
+            return true;
+        }
+
+        int32_t count;
+        sem_parker sema;
+        uint64_t acquisitions[phase_count];
+};
+
+mutex2_backoff::thresholds mutex2_backoff::config = { 100, 64, 5000 };
+
+void report_lock(const mutex2_backoff &mtx)
+{
+    static const char *const names[mutex2_backoff::phase_count] = { "first CAS", "pause backoff", "sched_yield", "semaphore" };
+
+    const uint64_t *acquisitions = mtx.phase_acquisitions();
+    uint64_t total = 0;
+    for (int p = 0; p != mutex2_backoff::phase_count; ++p)
+        total += acquisitions[p];
+
+    std::cout << "    acquired in phase:";
+    for (int p = 0; p != mutex2_backoff::phase_count; ++p)
+        std::cout << ' ' << names[p] << ' ' << (total ? 100.0 * acquisitions[p] / total : 0.0) << '%' << (p + 1 != mutex2_backoff::phase_count ? ',' : '\n');
+}
+
+// mutex2 that counts its CAS attempts. With TestFirst it spins on a plain load until the lock looks free and
+// only then tries the CAS (test-and-test-and-set), so waiters share the cache line instead of each CAS taking
+// it exclusive.
+template<bool TestFirst>
+class basic_mutex2_counted
+{
+    public:
+        basic_mutex2_counted() : count(0), acquisitions(0), cas_attempts(0) { }
+
+        void lock() { acquire(0); }
+
+        void unlock()
+        {
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_sub(&count, 1) > 1) // if (--count > 0)
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock() { return __sync_bool_compare_and_swap(&count, 0, 1); }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            return acquire(&deadline);
+        }
+
+        // Only read once the benchmark threads are done
+        double cas_per_acquisition() const { return acquisitions ? static_cast<double>(cas_attempts) / acquisitions : 0.0; }
+
+    private:
+        // No deadline waits forever
+        bool acquire(const timespec *deadline)
+        {
+            uint32_t attempts = 0;
+            for (unsigned spins = 0; spins != 5000 && !(deadline && expired(*deadline)); ++spins)
+            {
+                if (!TestFirst || load(count) == 0)
+                {
+                    ++attempts;
+                    if (__sync_bool_compare_and_swap(&count, 0, 1))
+                        return acquired(attempts);
+                }
+
+                sched_yield();
+            }
+
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_add(&count, 1) > 0) // if (++count > 1)
+            {
+                if (deadline == 0)
+                    sema.wait(); // wait for unlock
+                else if (!sema.wait_until(*deadline) && !stop_waiting(count, sema))
+                    return false;
+            }
+
+            return acquired(attempts);
+        }
+
+        // Called with the lock held, so the counters need no atomics
+        bool acquired(uint32_t attempts)
+        {
+            ++acquisitions;
+            cas_attempts += attempts;
+            return true;
+        }
+
+        int32_t count;
+        sem_parker sema;
+        uint64_t acquisitions;
+        uint64_t cas_attempts;  // excludes try_lock() and the fetch-and-add before waiting
+};
+
+typedef basic_mutex2_counted<false> mutex2_counted;
+typedef basic_mutex2_counted<true> mutex2_ttas;
+
+template<bool TestFirst>
+void report_lock(const basic_mutex2_counted<TestFirst> &mtx)
+{
+    std::cout << "    " << std::setprecision(3) << mtx.cas_per_acquisition() << " CAS attempts per acquisition\n";
+}
+
+// Spin-then-park lock that only spins while spinning can pay off: the owner publishes its thread id, and a
+// contending thread parks straight away if others are already parked on the semaphore or the owner isn't on a CPU.
+class mutex_adaptive
+{
+    public:
+        enum outcome
+        {
+            outcome_immediate,      // first CAS
+            outcome_spun,
+            outcome_parked_waiters, // parked because others were already parked
+            outcome_parked_owner,   // parked because the owner wasn't on a CPU
+            outcome_parked_spins,   // parked after spinning max_spins times
+            outcome_count
+        };
+
+        static const unsigned max_spins = 5000;
+        static const unsigned owner_check_interval = 256; // spins between reads of the owner's state
+
+        mutex_adaptive() : count(0), owner(0) { std::memset(acquisitions, 0, sizeof(acquisitions)); }
+
+        void lock() { acquire(0); }
+
+        void unlock()
+        {
+            owner = 0;
+
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_sub(&count, 1) > 1) // if (--count > 0)
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock()
+        {
+            if (!__sync_bool_compare_and_swap(&count, 0, 1))
+                return false;
+
+            owner = current_tid();
+            return true;
+        }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            return acquire(&deadline);
+        }
+
+        // Only read once the benchmark threads are done
+        const uint64_t *outcome_acquisitions() const { return acquisitions; }
+
+    private:
+        // No deadline waits forever
+        bool acquire(const timespec *deadline)
+        {
+            if (__sync_bool_compare_and_swap(&count, 0, 1))
+                return acquired(outcome_immediate);
+
+            outcome parked = outcome_parked_spins;
+            for (unsigned spins = 0; spins != max_spins && !(deadline && expired(*deadline)); ++spins)
+            {
+                const int32_t current = load(count);
+                if (current == 0)
+                {
+                    if (__sync_bool_compare_and_swap(&count, 0, 1))
+                        return acquired(outcome_spun);
+                    continue;
+                }
+
+                if (current > 1)
+                {
+                    parked = outcome_parked_waiters;
+                    break;
+                }
+
+                const pid_t holder = *static_cast<volatile pid_t *>(&owner);
+                if (spins % owner_check_interval == 0 && holder != 0 && !thread_on_cpu(holder))
+                {
+                    parked = outcome_parked_owner;
+                    break;
+                }
+
+                cpu_relax();
+            }
+
+            // NOTE: The GCC built-ins return the previous value so the values to check against needed to be changed
+            if (__sync_fetch_and_add(&count, 1) > 0) // if (++count > 1)
+            {
+                if (deadline == 0)
+                    sema.wait(); // wait for unlock
+                else if (!sema.wait_until(*deadline) && !stop_waiting(count, sema))
+                    return false;
+            }
+
+            return acquired(parked);
+        }
+
+        // Called with the lock held, so the counters need no atomics
+        bool acquired(outcome resolved)
+        {
+            owner = current_tid();
+            ++acquisitions[resolved];
+            return true;
+        }
+
+        int32_t count;
+        pid_t owner;    // 0 while unlocked or being handed over
+        sem_parker sema;
+        uint64_t acquisitions[outcome_count];
+};
+
+void report_lock(const mutex_adaptive &mtx)
+{
+    static const char *const names[mutex_adaptive::outcome_count] =
+        { "first CAS", "spinning", "parked behind waiters", "parked as owner off CPU", "parked after spinning" };
+
+    const uint64_t *acquisitions = mtx.outcome_acquisitions();
+    uint64_t total = 0;
+    for (int o = 0; o != mutex_adaptive::outcome_count; ++o)
+        total += acquisitions[o];
+
+    std::cout << "    acquired by:";
+    for (int o = 0; o != mutex_adaptive::outcome_count; ++o)
+        std::cout << ' ' << names[o] << ' ' << (total ? 100.0 * acquisitions[o] / total : 0.0) << '%' << (o + 1 != mutex_adaptive::outcome_count ? ',' : '\n');
+}
+
+// Lock straight on a futex, as in Drepper's "Futexes Are Tricky". With Private the futex calls pass
+// FUTEX_PRIVATE_FLAG, which lets the kernel key the futex by address instead of looking up the page behind it.
+template<bool Private>
+class basic_futex_lock
+{
+    public:
+        basic_futex_lock() : state(0), waits(0) { }
+
+        void lock()
+        {
+            if (try_lock())
+                return;
+
+            uint64_t waited = 0;
+            while (!try_lock_contended())
+            {
+                futex_wait(&state, 2, private_flag);
+                ++waited;
+            }
+            acquired(waited);
+        }
+
+        void unlock()
+        {
+            if (__sync_fetch_and_sub(&state, 1) != 1) // somebody may be waiting
+            {
+                *static_cast<volatile uint32_t *>(&state) = 0;
+                futex_wake(&state, 1, private_flag);
+            }
+        }
+
+        bool try_lock() { return __sync_bool_compare_and_swap(&state, 0, 1); }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            if (try_lock())
+                return true;
+
+            const timespec deadline = deadline_after(timeout_ns);
+            uint64_t waited = 0;
+            while (!try_lock_contended())
+            {
+                if (!futex_wait_until(&state, 2, deadline, private_flag))
+                    return try_lock_contended() && acquired(waited);
+                ++waited;
+            }
+
+            return acquired(waited);
+        }
+
+        // Takes the lock if it is free, otherwise marks it as having waiters so that unlock() wakes one of them
+        bool try_lock_contended() { return __sync_lock_test_and_set(&state, 2) == 0; }
+
+        // For waiting on several locks at once with futex_waitv
+        uint32_t *futex_word() { return &state; }
+        static int futex_flags() { return private_flag; }
+
+        uint64_t futex_waits() const { return waits; }
+
+    private:
+        static const int private_flag = Private ? FUTEX_PRIVATE_FLAG : 0;
+
+        // Called with the lock held, so the counter needs no atomics
+        bool acquired(uint64_t waited)
+        {
+            waits += waited;
+            return true;
+        }
+
+        uint32_t state; // 0 unlocked, 1 locked, 2 locked and maybe waited on
+        uint64_t waits;
+};
+
+typedef basic_futex_lock<true> futex_lock;
+typedef basic_futex_lock<false> futex_lock_shared;
+
+template<bool Private>
+void report_lock(const basic_futex_lock<Private> &mtx)
+{
+    std::cout << "    " << mtx.futex_waits() << " futex waits\n";
+}
+
+// Hemlock (Dice and Kogan): a FIFO queue lock with one word per lock and one word per thread, however many locks
+// the thread holds. The lock is the tail of the queue of threads, each identified by its grant word. A waiter spins
+// on its predecessor's grant word until that names this lock, then clears it to let the predecessor go.
+class hemlock
+{
+    public:
+        hemlock() : tail(0) { }
+
+        void lock()
+        {
+            grant_word *const predecessor = exchange(tail, &my_grant);
+            if (predecessor != 0)
+            {
+                wait_until_equal(predecessor->lock, this);
+                store(predecessor->lock, static_cast<hemlock *>(0));
+            }
+        }
+
+        void unlock()
+        {
+            if (__sync_bool_compare_and_swap(&tail, &my_grant, static_cast<grant_word *>(0)))
+                return;
+
+            // Hand over to the successor and wait until it has seen the grant, so the word is free for the next lock
+            store(my_grant.lock, this);
+            wait_until_equal(my_grant.lock, static_cast<hemlock *>(0));
+        }
+
+        bool try_lock() { return __sync_bool_compare_and_swap(&tail, static_cast<grant_word *>(0), &my_grant); }
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); }
+
+        static size_t thread_bytes() { return sizeof(hemlock *); }
+        static size_t padded_thread_bytes() { return sizeof(grant_word); }
+
+    private:
+        struct grant_word
+        {
+            char cache_line_separation1[64]; // keep the word that is spun on away from the thread's other variables
+            hemlock *lock;                   // the lock being handed over to the successor, otherwise 0
+            char cache_line_separation2[64];
+        };
+
+        static __thread grant_word my_grant;
+
+        grant_word *tail; // last thread holding or waiting for the lock, 0 while unlocked
+};
+
+__thread hemlock::grant_word hemlock::my_grant;
+
+void report_lock(const hemlock &)
+{
+    std::cout << "    " << sizeof(hemlock) << " bytes per lock, " << hemlock::thread_bytes() << " bytes per thread ("
+              << hemlock::padded_thread_bytes() << " with padding)\n";
+}
+
+// CLH queue lock (Craig, Landin and Hagersten) with one word nodes: the lock is the tail of a queue of nodes, each
+// waiter spins on its predecessor's node, and on getting the lock takes that node over to enqueue next time. So
+// there is one node per lock and one per thread instead of one per acquisition, but a thread can only hold or wait
+// for one clh_lock at a time. A thread's node is leaked when it exits.
+class clh_lock
+{
+    public:
+        clh_lock() : tail(new node), head(0) { tail->locked = 0; }
+        ~clh_lock() { delete tail; } // all the other nodes belong to threads
+
+        void lock()
+        {
+            node *const mine = own_node();
+            mine->locked = 1;
+            node *const predecessor = exchange(tail, mine);
+            wait_until_equal(predecessor->locked, 0);
+            acquired(mine, predecessor);
+        }
+
+        void unlock() { store(head->locked, 0); }
+
+        bool try_lock()
+        {
+            node *const predecessor = load(tail);
+            if (load(predecessor->locked) != 0)
+                return false;
+
+            node *const mine = own_node();
+            mine->locked = 1;
+            if (!__sync_bool_compare_and_swap(&tail, predecessor, mine))
+                return false;
+
+            // Only waits if the predecessor's node was taken over and enqueued again since it was checked
+            wait_until_equal(predecessor->locked, 0);
+            acquired(mine, predecessor);
+            return true;
+        }
+
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); }
+
+        static size_t lock_bytes() { return sizeof(clh_lock) + sizeof(node); }
+        static size_t thread_bytes() { return sizeof(node) + sizeof(spare); }
+
+    private:
+        struct node
+        {
+            int32_t locked; // 1 while the owner of the node holds or waits for the lock
+        };
+
+        node *own_node()
+        {
+            if (spare == 0)
+                spare = new node;
+            return spare;
+        }
+
+        // Called with the lock held
+        void acquired(node *mine, node *predecessor)
+        {
+            head = mine;
+            spare = predecessor;
+        }
+
+        static __thread node *spare; // the node this thread enqueues next
+
+        node *tail;
+        node *head; // the node of the thread holding the lock
+};
+
+__thread clh_lock::node *clh_lock::spare = 0;
+
+void report_lock(const clh_lock &)
+{
+    std::cout << "    " << clh_lock::lock_bytes() << " bytes per lock, " << clh_lock::thread_bytes() << " bytes per thread\n";
+}
+
+// MCS queue lock (Mellor-Crummey and Scott), optionally with shuffling as in ShflLock (Kashyap et al.): the
+// waiter at the head of the queue moves waiters from its own socket up behind itself while it waits, so the lock
+// stays on one socket for longer, up to max_local_handoffs handoffs in a row. Each thread
+// has one queue node, so a thread can only hold or wait for one of these locks at a time.
+template<bool Shuffle>
+class basic_mcs_lock
+{
+    public:
+        basic_mcs_lock() : tail(0), handoffs(0), local_handoffs(0), shuffles(0), moved(0) { }
+
+        void lock()
+        {
+            queue_node &mine = my_node.node;
+            mine.next = 0;
+            mine.waiting = 1;
+            mine.shuffler = 0;
+            mine.batch = 0;
+            mine.socket = current_socket();
+
+            queue_node *const predecessor = exchange(tail, &mine);
+            if (predecessor == 0)
+                return;
+
+            store(predecessor->next, &mine);
+            for (bool shuffled = false; load(mine.waiting) != 0;)
+            {
+                if (Shuffle && !shuffled && load(mine.shuffler) != 0)
+                {
+                    shuffle(mine);
+                    shuffled = true;
+                    continue;
+                }
+
+                for (int spins = 0; spins != 64 && load(mine.waiting) != 0; ++spins)
+                    cpu_relax();
+
+                if (load(mine.waiting) != 0)
+                    sched_yield();
+            }
+
+            // Now the successor is at the head of the queue
+            queue_node *const next = load(mine.next);
+            if (Shuffle && next != 0)
+                store(next->shuffler, 1);
+        }
+
+        void unlock()
+        {
+            queue_node &mine = my_node.node;
+            queue_node *next = load(mine.next);
+            if (next == 0)
+            {
+                if (__sync_bool_compare_and_swap(&tail, &mine, static_cast<queue_node *>(0)))
+                    return;
+
+                while ((next = load(mine.next)) == 0) // the successor is between joining and linking in
+                    cpu_relax();
+            }
+
+            ++handoffs;
+            if (next->socket == mine.socket)
+                ++local_handoffs;
+            store(next->waiting, 0);
+        }
+
+        bool try_lock()
+        {
+            queue_node &mine = my_node.node;
+            mine.next = 0;
+            mine.socket = current_socket();
+            return __sync_bool_compare_and_swap(&tail, static_cast<queue_node *>(0), &mine);
+        }
+
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); }
+
+        uint64_t handoff_count() const { return handoffs; }
+        uint64_t local_handoff_count() const { return local_handoffs; }
+        uint64_t shuffle_count() const { return shuffles; }
+        uint64_t moved_count() const { return moved; }
+
+    private:
+        struct queue_node
+        {
+            queue_node *next;
+            int32_t waiting;
+            int32_t shuffler; // set once the node is at the head of the queue
+            uint32_t batch;   // handoffs in a row to this node's socket up to this node
+            unsigned socket;
+        };
+
+        struct padded_node
+        {
+            char cache_line_separation1[64]; // keep the node that is spun on away from the thread's other variables
+            queue_node node;
+            char cache_line_separation2[64];
+        };
+
+        // Moves the waiters behind mine that are on its socket up to just behind it, keeping their order. Nodes
+        // without a successor yet are left alone, as joining threads write to their next field.
+        void shuffle(queue_node &mine)
+        {
+            ++shuffles; // only one waiter shuffles at a time, the lock owner having made it the head of the queue
+            if (mine.batch + 1 >= local_handoff_limit())
+                return;
+
+            queue_node *last = &mine; // end of the run on mine's socket
+            queue_node *previous = &mine;
+            for (queue_node *node = load(mine.next); node != 0;)
+            {
+                queue_node *const next = load(node->next);
+                if (next == 0)
+                    break;
+
+                if (node->socket == mine.socket)
+                {
+                    if (last->batch + 1 >= local_handoff_limit())
+                        break;
+
+                    node->batch = last->batch + 1;
+                    if (previous != last)
+                    {
+                        store(previous->next, next);
+                        node->next = last->next;
+                        store(last->next, node);
+                        ++moved;
+                    }
+                    else
+                        previous = node;
+                    last = node;
+                }
+                else
+                    previous = node;
+
+                node = next;
+            }
+        }
+
+        static __thread padded_node my_node;
+
+        queue_node *tail; // last thread holding or waiting for the lock, 0 while unlocked
+
+        // Only changed with the lock held, or by the single shuffler
+        uint64_t handoffs;
+        uint64_t local_handoffs;
+        uint64_t shuffles;
+        uint64_t moved;
+};
+
+template<bool Shuffle>
+__thread typename basic_mcs_lock<Shuffle>::padded_node basic_mcs_lock<Shuffle>::my_node;
+
+typedef basic_mcs_lock<false> mcs_lock;
+typedef basic_mcs_lock<true> shuffle_lock;
+
+template<bool Shuffle>
+void report_lock(const basic_mcs_lock<Shuffle> &mtx)
+{
+    const uint64_t handoffs = mtx.handoff_count();
+    std::cout << "    " << handoffs << " handoffs, " << std::setprecision(1) << (handoffs ? 100.0 * mtx.local_handoff_count() / handoffs : 0.0)
+              << "% to the same socket";
+    if (Shuffle)
+        std::cout << ", " << mtx.moved_count() << " waiters moved up in " << mtx.shuffle_count() << " shuffles";
+    std::cout << '\n';
+}
+
+// Hierarchical backoff lock (Radovic and Hagersten): a test-and-set lock whose word holds the owner's socket, so
+// that contending threads on that socket back off for less time than remote ones and the lock tends to stay on one
+// socket. Once a socket has had max_local_handoffs acquisitions in a row while threads on other sockets wait, it is
+// closed: its threads hold off until another socket takes the lock or they have held off for refrain_rounds backoffs.
+class hbo_lock
+{
+    public:
+        struct thresholds
+        {
+            unsigned local_backoff;  // cap on the pause instructions between attempts while the owner is on our socket
+            unsigned remote_backoff; // cap while it is on another socket
+        };
+
+        static thresholds config;
+        static const unsigned refrain_rounds = 16;
+        static const unsigned max_sockets = 8; // waiters are counted per socket modulo this
+
+        hbo_lock() : state(0), closed(0), last_socket(0), streak(0), acquisitions(0), local_acquisitions(0), longest_streak(0),
+                     closings(0), reopenings(0)
+        {
+            std::memset(waiting, 0, sizeof(waiting));
+        }
+
+        void lock() { acquire(0); }
+        void unlock() { store(state, 0); }
+
+        bool try_lock()
+        {
+            const uint32_t mine = current_socket() + 1;
+            return load(closed) != mine && __sync_bool_compare_and_swap(&state, 0, mine) && acquired(mine, false);
+        }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            const timespec deadline = deadline_after(timeout_ns);
+            return acquire(&deadline);
+        }
+
+        // Only read once the benchmark threads are done
+        uint64_t acquisition_count() const { return acquisitions; }
+        uint64_t local_acquisition_count() const { return local_acquisitions; }
+        uint32_t longest_local_streak() const { return longest_streak; }
+        uint64_t closing_count() const { return closings; }
+        uint64_t reopening_count() const { return reopenings; }
+
+    private:
+        // No deadline waits forever
+        bool acquire(const timespec *deadline)
+        {
+            const uint32_t mine = current_socket() + 1;
+            if (load(closed) != mine && __sync_bool_compare_and_swap(&state, 0, mine))
+                return acquired(mine, false);
+
+            int32_t &waiters = waiting[mine % max_sockets];
+            __sync_fetch_and_add(&waiters, 1);
+            const bool result = contend(mine, deadline);
+            __sync_fetch_and_sub(&waiters, 1);
+            return result;
+        }
+
+        bool contend(uint32_t mine, const timespec *deadline)
+        {
+            unsigned backoff = 1;
+            for (unsigned refrained = 0;;)
+            {
+                const uint32_t owner = load(state);
+                bool held_off = load(closed) == mine;
+                if (held_off && refrained == refrain_rounds)
+                    held_off = !__sync_bool_compare_and_swap(&closed, mine, 0) && load(closed) == mine;
+
+                if (owner == 0 && !held_off && __sync_bool_compare_and_swap(&state, 0, mine))
+                    return acquired(mine, refrained >= refrain_rounds);
+
+                if (deadline && expired(*deadline))
+                    return false;
+
+                const unsigned cap = owner == mine && !held_off ? config.local_backoff : config.remote_backoff;
+                backoff = std::min(backoff, cap);
+                for (uint32_t delay = backoff + thread_random() % backoff; delay != 0; --delay)
+                    cpu_relax();
+
+                if (backoff < cap)
+                    backoff *= 2;
+                else
+                    sched_yield(); // the owner may be waiting for a CPU
+
+                if (held_off)
+                    ++refrained;
+            }
+        }
+
+        // Called with the lock held, so the counters need no atomics
+        bool acquired(uint32_t mine, bool reopened)
+        {
+            ++acquisitions;
+            if (reopened)
+                ++reopenings;
+
+            if (mine != last_socket)
+            {
+                last_socket = mine;
+                streak = 1;
+                if (closed != 0)
+                    store(closed, 0);
+                return true;
+            }
+
+            ++local_acquisitions;
+            longest_streak = std::max(longest_streak, ++streak);
+            if (streak >= local_handoff_limit() && closed != mine && others_waiting(mine))
+            {
+                store(closed, mine);
+                ++closings;
+            }
+
+            return true;
+        }
+
+        bool others_waiting(uint32_t mine) const
+        {
+            for (unsigned socket = 0; socket != max_sockets; ++socket)
+            {
+                if (socket != mine % max_sockets && load(waiting[socket]) != 0)
+                    return true;
+            }
+
+            return false;
+        }
+
+        uint32_t state;  // owner's socket + 1, 0 while unlocked
+        uint32_t closed; // socket + 1 of a socket holding off, otherwise 0
+        int32_t waiting[max_sockets]; // threads backing off, by socket
+
+        uint32_t last_socket;
+        uint32_t streak; // acquisitions in a row on last_socket
+        uint64_t acquisitions;
+        uint64_t local_acquisitions;
+        uint32_t longest_streak;
+        uint64_t closings;
+        uint64_t reopenings; // acquisitions by threads that gave up holding off
+};
+
+hbo_lock::thresholds hbo_lock::config = { 16, 1024 };
+
+void report_lock(const hbo_lock &mtx)
+{
+    const uint64_t acquisitions = mtx.acquisition_count();
+    std::cout << "    " << std::setprecision(1) << (acquisitions ? 100.0 * mtx.local_acquisition_count() / acquisitions : 0.0)
+              << "% of acquisitions on the previous owner's socket, at most " << mtx.longest_local_streak() << " in a row, "
+              << mtx.closing_count() << " times closed to its socket, " << mtx.reopening_count() << " reopened by waiting\n";
+}
+
+// Read/write lock with optimistic reads, like Java's StampedLock. Readers can skip the lock entirely: take a
+// stamp, read, and validate that no writer held or released the lock in between.
+class stamped_lock
+{
+    public:
+        stamped_lock() : state(version_unit) { } // version starts at 1 as stamp 0 means write locked
+
+        void lock()
+        {
+            for (;;)
+            {
+                const uint32_t current = load(state);
+                if ((current & (write_bit | reader_mask)) == 0 && __sync_bool_compare_and_swap(&state, current, current | write_bit))
+                    return;
+
+                sched_yield();
+            }
+        }
+
+        void unlock() { __sync_fetch_and_add(&state, version_unit - write_bit); } // new version, write bit cleared
+
+        void lock_shared()
+        {
+            for (;;)
+            {
+                const uint32_t current = load(state);
+                if ((current & write_bit) == 0 && (current & reader_mask) != reader_mask &&
+                    __sync_bool_compare_and_swap(&state, current, current + 1))
+                    return;
+
+                sched_yield();
+            }
+        }
+
+        void unlock_shared() { __sync_fetch_and_sub(&state, 1); }
+
+        // Returns 0 while a writer holds the lock, so that validate() fails
+        uint32_t try_optimistic_read()
+        {
+            const uint32_t current = load(state);
+            __sync_synchronize(); // the reads being validated come after the stamp
+            return (current & write_bit) ? 0 : (current & ~reader_mask);
+        }
+
+        // Whether nothing was written since try_optimistic_read() returned stamp
+        bool validate(uint32_t stamp)
+        {
+            __sync_synchronize(); // the reads being validated come before the check
+            return stamp != 0 && (load(state) & ~reader_mask) == stamp;
+        }
+
+    private:
+        static const uint32_t reader_mask = 0x7f;
+        static const uint32_t write_bit = 0x80;
+        static const uint32_t version_unit = 0x100;
+
+        static uint32_t load(const uint32_t &value) { return *static_cast<const volatile uint32_t *>(&value); }
+
+        uint32_t state; // version << 8 | write bit << 7 | readers
+};
+
+#if __cplusplus >= 202002L
+
+// Memory ordering of one kind of atomic operation in the C++20 locks
+enum class ordering
+{
+    seq_cst,        // memory_order_seq_cst
+    acq_rel,        // memory_order_acquire on the acquire side, memory_order_release on the release side
+    relaxed_fence   // memory_order_relaxed plus a separate std::atomic_thread_fence
+};
+
+constexpr std::memory_order acquire_order(ordering order)
+{
+    return order == ordering::seq_cst ? std::memory_order_seq_cst :
+           order == ordering::acq_rel ? std::memory_order_acquire : std::memory_order_relaxed;
+}
+
+constexpr std::memory_order release_order(ordering order)
+{
+    return order == ordering::seq_cst ? std::memory_order_seq_cst :
+           order == ordering::acq_rel ? std::memory_order_release : std::memory_order_relaxed;
+}
+
+// Goes after an operation done with acquire_order(Order)
+template<ordering Order>
+void acquire_fence()
+{
+    if constexpr (Order == ordering::relaxed_fence)
+        std::atomic_thread_fence(std::memory_order_acquire);
+}
+
+// Goes before an operation done with release_order(Order)
+template<ordering Order>
+void release_fence()
+{
+    if constexpr (Order == ordering::relaxed_fence)
+        std::atomic_thread_fence(std::memory_order_release);
+}
+
+// Counting semaphore that parks on std::atomic::wait, used by the C++20 locks in place of sem_t.
+// Taking a token is ordered as Acquire, posting one as Release and re-reading the token count while waiting as Spin.
+template<ordering Acquire, ordering Release, ordering Spin>
+class basic_atomic_sema
+{
+    public:
+        void post()
+        {
+            release_fence<Release>();
+            tokens.fetch_add(1, release_order(Release));
+            tokens.notify_one();
+        }
+
+        void wait()
+        {
+            uint32_t current = tokens.load(acquire_order(Spin));
+            for (;;)
+            {
+                while (current == 0)
+                {
+                    tokens.wait(0, acquire_order(Spin));
+                    current = tokens.load(acquire_order(Spin));
+                }
+                acquire_fence<Spin>();
+
+                if (tokens.compare_exchange_weak(current, current - 1, acquire_order(Acquire), std::memory_order_relaxed))
+                    break;
+            }
+            acquire_fence<Acquire>();
+        }
+
+    private:
+        std::atomic<uint32_t> tokens{0};
+};
+
+// benaphore on std::atomic. Acquire orders the increment in lock() and try_lock(), Release the decrement
+// in unlock() and Spin the reads while parked (see basic_atomic_sema).
+template<ordering Acquire, ordering Release, ordering Spin>
+class basic_benaphore_atomic
+{
+    public:
+        void lock()
+        {
+            const int32_t previous = count.fetch_add(1, acquire_order(Acquire));
+            acquire_fence<Acquire>();
+            if (previous > 0) // if (++count > 1)
+                sema.wait(); // wait for unlock
+        }
+
+        void unlock()
+        {
+            release_fence<Release>();
+            if (count.fetch_sub(1, release_order(Release)) > 1) // if (--count > 0)
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock()
+        {
+            int32_t expected = 0;
+            if (!count.compare_exchange_strong(expected, 1, acquire_order(Acquire), std::memory_order_relaxed))
+                return false;
+
+            acquire_fence<Acquire>();
+            return true;
+        }
+
+        // std::atomic::wait has no timeout
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); }
+
+    private:
+        std::atomic<int32_t> count{0};
+        basic_atomic_sema<Acquire, Release, Spin> sema;
+};
+
+// mutex2 on std::atomic, with the same ordering parameters as basic_benaphore_atomic
+template<ordering Acquire, ordering Release, ordering Spin>
+class basic_mutex2_atomic
+{
+    public:
+        void lock()
+        {
+            for (unsigned spins = 0; spins != 5000; ++spins)
+            {
+                if (try_lock())
+                    return;
+
+                sched_yield();
+            }
+
+            const int32_t previous = count.fetch_add(1, acquire_order(Acquire));
+            acquire_fence<Acquire>();
+            if (previous > 0) // if (++count > 1)
+                sema.wait(); // wait for unlock
+        }
+
+        void unlock()
+        {
+            release_fence<Release>();
+            if (count.fetch_sub(1, release_order(Release)) > 1) // if (--count > 0)
+                sema.post(); // release a waiting thread
+        }
+
+        bool try_lock()
+        {
+            int32_t expected = 0;
+            if (!count.compare_exchange_strong(expected, 1, acquire_order(Acquire), std::memory_order_relaxed))
+                return false;
+
+            acquire_fence<Acquire>();
+            return true;
+        }
+
+        // std::atomic::wait has no timeout
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); }
+
+    private:
+        std::atomic<int32_t> count{0};
+        basic_atomic_sema<Acquire, Release, Spin> sema;
+};
+
+typedef basic_benaphore_atomic<ordering::acq_rel, ordering::acq_rel, ordering::acq_rel> benaphore_atomic;
+typedef basic_mutex2_atomic<ordering::acq_rel, ordering::acq_rel, ordering::acq_rel> mutex2_atomic;
+
+// Standard library lock with the try_lock_for signature used here; std::shared_mutex is used in exclusive mode
+template<typename Lockable>
+class std_lock
+{
+    public:
+        void lock() { m.lock(); }
+        void unlock() { m.unlock(); }
+        bool try_lock() { return m.try_lock(); }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            if constexpr (requires { m.try_lock_for(std::chrono::nanoseconds(timeout_ns)); })
+                return m.try_lock_for(std::chrono::nanoseconds(timeout_ns));
+            else
+                return poll_try_lock_for(*this, timeout_ns);
+        }
+
+    private:
+        Lockable m;
+};
+
+// std::binary_semaphore used directly as a lock
+class std_binary_semaphore
+{
+    public:
+        void lock() { sema.acquire(); }
+        void unlock() { sema.release(); }
+        bool try_lock() { return sema.try_acquire(); }
+        bool try_lock_for(uint64_t timeout_ns) { return sema.try_acquire_for(std::chrono::nanoseconds(timeout_ns)); }
+
+    private:
+        std::binary_semaphore sema{1};
+};
+
+// benaphore parked on std::counting_semaphore instead of sem_t
+class benaphore_std_semaphore
+{
+    public:
+        void lock()
+        {
+            if (count.fetch_add(1, std::memory_order_acquire) > 0) // if (++count > 1)
+                sema.acquire(); // wait for unlock
+        }
+
+        void unlock()
+        {
+            if (count.fetch_sub(1, std::memory_order_release) > 1) // if (--count > 0)
+                sema.release(); // release a waiting thread
+        }
+
+        bool try_lock()
+        {
+            int32_t expected = 0;
+            return count.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        bool try_lock_for(uint64_t timeout_ns)
+        {
+            if (count.fetch_add(1, std::memory_order_acquire) == 0) // if (++count == 1)
+                return true;
+
+            if (sema.try_acquire_for(std::chrono::nanoseconds(timeout_ns)))
+                return true;
+
+            // Same as benaphore::stop_waiting()
+            int32_t current = count.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if (current == 1)
+                {
+                    sema.acquire();
+                    return true;
+                }
+
+                if (count.compare_exchange_weak(current, current - 1, std::memory_order_relaxed))
+                    return false;
+            }
+        }
+
+    private:
+        std::atomic<int32_t> count{0};
+        std::counting_semaphore<> sema{0};
+};
+
+// Runs coroutines on a fixed set of threads
+class thread_pool_executor
+{
+    public:
+        explicit thread_pool_executor(unsigned num_threads)
+        {
+            for (unsigned t = 0; t != num_threads; ++t)
+                threads.emplace_back([this] { run(); });
+        }
+
+        ~thread_pool_executor()
+        {
+            {
+                std::lock_guard<std::mutex> guard(queue_mutex);
+                stopping = true;
+            }
+            ready.notify_all();
+
+            for (std::thread &thread : threads)
+                thread.join();
+        }
+
+        void post(std::coroutine_handle<> coroutine)
+        {
+            {
+                std::lock_guard<std::mutex> guard(queue_mutex);
+                queue.push_back(coroutine);
+            }
+            ready.notify_one();
+        }
+
+        // co_await schedule() continues the coroutine from the back of the queue
+        auto schedule()
+        {
+            struct awaiter
+            {
+                thread_pool_executor &executor;
+
+                bool await_ready() const { return false; }
+                void await_suspend(std::coroutine_handle<> coroutine) { executor.post(coroutine); }
+                void await_resume() const { }
+            };
+
+            return awaiter{*this};
+        }
+
+    private:
+        void run()
+        {
+            for (;;)
+            {
+                std::coroutine_handle<> coroutine;
+                {
+                    std::unique_lock<std::mutex> guard(queue_mutex);
+                    ready.wait(guard, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+
+                    coroutine = queue.front();
+                    queue.pop_front();
+                }
+
+                coroutine.resume();
+            }
+        }
+
+        std::mutex queue_mutex;
+        std::condition_variable ready;
+        std::deque<std::coroutine_handle<> > queue;
+        bool stopping = false;
+        std::vector<std::thread> threads;
+};
+
+// Mutex for coroutines: co_await lock() suspends the coroutine onto a lock-free list of waiters instead of
+// blocking its thread, and unlock() hands the lock to the oldest waiter and resumes it on the executor.
+class async_mutex
+{
+    public:
+        class lock_awaiter
+        {
+            public:
+                explicit lock_awaiter(async_mutex &mtx) : mtx(mtx) { }
+
+                bool await_ready() const { return false; }
+
+                // Returns false to continue straight away when the lock was free
+                bool await_suspend(std::coroutine_handle<> coroutine)
+                {
+                    waiter = coroutine;
+                    void *current = mtx.state.load(std::memory_order_acquire);
+                    for (;;)
+                    {
+                        if (current == mtx.unlocked())
+                        {
+                            if (mtx.state.compare_exchange_weak(current, nullptr, std::memory_order_acquire, std::memory_order_acquire))
+                            {
+                                suspended = false;
+                                return false;
+                            }
+                        }
+                        else
+                        {
+                            next = static_cast<lock_awaiter *>(current);
+                            suspended = true; // before the push, as the coroutine may be resumed right after it
+                            if (mtx.state.compare_exchange_weak(current, this, std::memory_order_release, std::memory_order_acquire))
+                                return true;
+                        }
+                    }
+                }
+
+                void await_resume()
+                {
+                    if (suspended)
+                        ++mtx.suspensions; // the lock is held
+                }
+
+            private:
+                friend class async_mutex;
+
+                async_mutex &mtx;
+                std::coroutine_handle<> waiter;
+                lock_awaiter *next = nullptr;
+                bool suspended = false;
+        };
+
+        explicit async_mutex(thread_pool_executor &executor) : executor(executor), state(unlocked()) { }
+
+        lock_awaiter lock() { return lock_awaiter(*this); }
+
+        void unlock()
+        {
+            if (oldest == nullptr)
+            {
+                void *current = nullptr;
+                if (state.compare_exchange_strong(current, unlocked(), std::memory_order_release, std::memory_order_relaxed))
+                    return;
+
+                // Take the newly pushed waiters, newest first, and reverse them into oldest first order
+                current = state.exchange(nullptr, std::memory_order_acquire);
+                for (lock_awaiter *waiter = static_cast<lock_awaiter *>(current); waiter != nullptr; )
+                {
+                    lock_awaiter *next = waiter->next;
+                    waiter->next = oldest;
+                    oldest = waiter;
+                    waiter = next;
+                }
+            }
+
+            lock_awaiter *waiter = oldest; // the lock passes to it directly
+            oldest = waiter->next;
+            executor.post(waiter->waiter);
+        }
+
+        // Only read once the coroutines are done
+        uint64_t contended_acquisitions() const { return suspensions; }
+
+    private:
+        void *unlocked() { return this; }
+
+        thread_pool_executor &executor;
+        std::atomic<void *> state;          // unlocked(), nullptr when locked without waiters, otherwise the newest waiter
+        lock_awaiter *oldest = nullptr;     // waiters already taken from state, only touched by the holder
+        uint64_t suspensions = 0;
+};
+
+// Chase-Lev work-stealing deque of non-zero values (Le, Pop, Cohen and Zappa Nardelli's C11 version). The owner
+// pushes and pops at the bottom, other threads steal from the top; the ring buffer doubles when full.
+class chase_lev_deque
+{
+    public:
+        enum steal_result { stolen, empty, lost_race };
+
+        chase_lev_deque() : buffer(new ring(64)) { retired.emplace_back(buffer.load(std::memory_order_relaxed)); }
+
+        // Owner only
+        void push(uint64_t value)
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed);
+            const int64_t t = top.load(std::memory_order_acquire);
+            ring *items = buffer.load(std::memory_order_relaxed);
+            if (b - t > items->capacity - 1)
+                items = grow(items, t, b);
+
+            items->put(b, value);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Owner only; returns 0 if empty
+        uint64_t pop()
+        {
+            const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            ring *items = buffer.load(std::memory_order_relaxed);
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+
+            uint64_t value = 0;
+            if (t <= b)
+            {
+                value = items->get(b);
+                if (t == b)
+                {
+                    // Last item, race the stealers for it
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                        value = 0;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            }
+            else
+                bottom.store(b + 1, std::memory_order_relaxed);
+
+            return value;
+        }
+
+        steal_result steal(uint64_t &value)
+        {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b)
+                return empty;
+
+            value = buffer.load(std::memory_order_acquire)->get(t);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                return lost_race;
+
+            return stolen;
+        }
+
+    private:
+        struct ring
+        {
+            explicit ring(int64_t capacity) : capacity(capacity), items(new std::atomic<uint64_t>[capacity]) { }
+
+            uint64_t get(int64_t index) const { return items[index & (capacity - 1)].load(std::memory_order_relaxed); }
+            void put(int64_t index, uint64_t value) { items[index & (capacity - 1)].store(value, std::memory_order_relaxed); }
+
+            const int64_t capacity; // power of 2
+            std::unique_ptr<std::atomic<uint64_t>[]> items;
+        };
+
+        ring *grow(ring *items, int64_t t, int64_t b)
+        {
+            ring *bigger = new ring(items->capacity * 2);
+            for (int64_t i = t; i != b; ++i)
+                bigger->put(i, items->get(i));
+
+            retired.emplace_back(bigger); // stealers may still read the old rings, so all are kept until destruction
+            buffer.store(bigger, std::memory_order_release);
+            return bigger;
+        }
+
+        alignas(64) std::atomic<int64_t> top{0};
+        alignas(64) std::atomic<int64_t> bottom{0};
+        std::atomic<ring *> buffer;
+        std::vector<std::unique_ptr<ring> > retired;
+};
+
+// Fork-join pool with a Chase-Lev deque per worker. A task is a count of work units: a worker splits tasks
+// larger than the grain in half, pushing one half for itself or thieves to pick up, and hands the rest to body.
+class work_stealing_pool
+{
+    public:
+        struct worker_stats
+        {
+            uint64_t tasks = 0;
+            uint64_t steal_attempts = 0;
+            uint64_t steals = 0;
+
+            char cache_line_separation[64];
+        };
+
+        work_stealing_pool(unsigned num_workers) : deques(num_workers), stats(num_workers) { }
+
+        // Runs body(worker, units) until total units are done; returns the elapsed seconds
+        template<typename Body>
+        double run(uint64_t total, uint64_t grain, Body body)
+        {
+            remaining.store(total, std::memory_order_relaxed);
+            deques[0].push(total);
+
+            std::vector<std::thread> threads;
+            const double start = now_seconds();
+            for (unsigned w = 0; w != deques.size(); ++w)
+                threads.emplace_back([this, w, grain, &body] { work(w, grain, body); });
+
+            for (std::thread &thread : threads)
+                thread.join();
+
+            return now_seconds() - start;
+        }
+
+        const std::vector<worker_stats> &worker_statistics() const { return stats; }
+
+    private:
+        template<typename Body>
+        void work(unsigned worker, uint64_t grain, Body &body)
+        {
+            chase_lev_deque &own = deques[worker];
+            worker_stats &mine = stats[worker];
+
+            while (remaining.load(std::memory_order_acquire) != 0)
+            {
+                uint64_t units = own.pop();
+                if (units == 0 && deques.size() > 1)
+                {
+                    const unsigned victim = (worker + 1 + thread_random() % (deques.size() - 1)) % deques.size();
+                    ++mine.steal_attempts;
+                    if (deques[victim].steal(units) == chase_lev_deque::stolen)
+                        ++mine.steals;
+                    else
+                        units = 0;
+                }
+
+                if (units == 0)
+                {
+                    sched_yield();
+                    continue;
+                }
+
+                for (; units > grain; units -= units / 2)
+                    own.push(units / 2);
+
+                body(worker, units);
+                ++mine.tasks;
+                remaining.fetch_sub(units, std::memory_order_release);
+            }
+        }
+
+        std::vector<chase_lev_deque> deques;
+        std::vector<worker_stats> stats;
+        std::atomic<uint64_t> remaining{0};
+};
+
+#endif // __cplusplus >= 202002L
+
+// Lock implementation loaded from a shared object, called through the plugin ABI
+class plugin_mutex
+{
+    public:
+        plugin_mutex() : handle(table->create()) { CHECK( handle != 0 ); }
+        ~plugin_mutex() { table->destroy(handle); }
+
+        void lock() { table->lock(handle); }
+        void unlock() { table->unlock(handle); }
+        bool try_lock() { return table->try_lock(handle) != 0; }
+        bool try_lock_for(uint64_t timeout_ns) { return poll_try_lock_for(*this, timeout_ns); } // not part of the ABI
+
+        static const test_mutex_plugin *table;
+
+    private:
+        void *handle;
+};
+
+// Plugin ABI wrapped around the pthreads mutex, used to measure the cost of the indirect calls
+namespace builtin
+{
+    void *create() { return new mutex; }
+    void destroy(void *lock) { delete static_cast<mutex *>(lock); }
+    void lock(void *lock) { static_cast<mutex *>(lock)->lock(); }
+    void unlock(void *lock) { static_cast<mutex *>(lock)->unlock(); }
+    int try_lock(void *lock) { return static_cast<mutex *>(lock)->try_lock(); }
+
+    const test_mutex_plugin plugin = { TEST_MUTEX_PLUGIN_ABI_VERSION, "builtin_mutex", create, destroy, lock, unlock, try_lock };
+}
+
+const test_mutex_plugin *plugin_mutex::table = &builtin::plugin;
+
+const test_mutex_plugin *load_plugin(const char *path)
+{
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL); // stays loaded for the life of the process
+    if (library == 0)
+    {
+        std::cerr << dlerror() << '\n';
+        return 0;
+    }
+
+    const test_mutex_plugin *table = static_cast<const test_mutex_plugin *>(dlsym(library, TEST_MUTEX_PLUGIN_SYMBOL));
+    if (table == 0 || table->abi_version != TEST_MUTEX_PLUGIN_ABI_VERSION ||
+        table->create == 0 || table->destroy == 0 || table->lock == 0 || table->unlock == 0 || table->try_lock == 0)
+    {
+        std::cerr << path << ": no usable " << TEST_MUTEX_PLUGIN_SYMBOL << " (ABI version " << TEST_MUTEX_PLUGIN_ABI_VERSION << ")\n";
+        return 0;
+    }
+
+    return table;
+}
+
+template<typename Mutex>
+double uncontended_ns(uint32_t iterations)
+{
+    Mutex mtx;
+
+    const double start = now_seconds();
+    for (uint32_t i = 0; i != iterations; ++i)
+    {
+        mtx.lock();
+        mtx.unlock();
+    }
+
+    return (now_seconds() - start) * 1e9 / iterations;
+}
+
+// Single threaded lock/unlock cost of the plugin, and of the pthreads mutex called directly and through the plugin ABI
+void report_plugin_overhead()
+{
+    const uint32_t iterations = 10 * 1000 * 1000;
+
+    const test_mutex_plugin *loaded = plugin_mutex::table;
+    const double direct = uncontended_ns<mutex>(iterations);
+    plugin_mutex::table = &builtin::plugin;
+    const double indirect = uncontended_ns<plugin_mutex>(iterations);
+    plugin_mutex::table = loaded;
+    const double plugin = uncontended_ns<plugin_mutex>(iterations);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "plugin " << loaded->name << ": " << plugin << " ns per uncontended lock/unlock"
+              << " (pthreads mutex " << direct << " ns direct, " << indirect << " ns through the plugin ABI,"
+              << " indirect call overhead " << (indirect - direct) << " ns)\n";
+}
+
+enum benchmark_mode
+{
+    mode_lock,      // lock()
+    mode_try_lock,  // try_lock(), falling back to lock()
+    mode_timed_lock // try_lock_for(timeout), falling back to lock()
+};
+
+// Where shared_stuff puts the lock and the counter it protects. Both live in a block of their own aligned to
+// 128 bytes, the pair of cache lines that adjacent-line prefetchers fetch together.
+enum stuff_layout
+{
+    layout_separate,    // each on its own 64 byte cache line
+    layout_colocated,   // the counter right after the lock, sharing its cache line if it fits
+    layout_separate128, // each on its own 128 byte pair of cache lines
+    layout_count
+};
+
+const char *const layout_names[layout_count] = { "separate", "colocated", "separate128" };
+
+// Offset of the counter from the lock, which starts the block
+size_t counter_offset(stuff_layout layout, size_t lock_size)
+{
+    switch (layout)
+    {
+        case layout_colocated:
+            return (lock_size + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t);
+
+        case layout_separate128:
+            return (lock_size + 127) / 128 * 128;
+
+        default:
+            return (lock_size + 63) / 64 * 64;
+    }
+}
+
+// Offset of the protected buffer from the lock: the line (or, for separate128, pair of lines) after the counter's
+size_t buffer_offset(stuff_layout layout, size_t lock_size)
+{
+    const size_t end = counter_offset(layout, lock_size) + sizeof(uint32_t);
+    return layout == layout_separate128 ? (end + 127) / 128 * 128 : (end + 63) / 64 * 64;
+}
+
+const size_t words_per_line = 64 / sizeof(uint64_t);
+const unsigned max_lines = 4096;
+
+// What allocate_lines backs its blocks with: regular pages, transparent huge pages (madvise) or hugetlbfs pages
+// (MAP_HUGETLB), each falling back to the next if the system has none to give
+enum huge_pages_mode
+{
+    huge_pages_off,
+    huge_pages_thp,
+    huge_pages_hugetlb,
+    huge_pages_count
+};
+
+const char *const huge_pages_names[huge_pages_count] = { "off", "thp", "hugetlb" };
+
+huge_pages_mode huge_pages = huge_pages_off;
+huge_pages_mode last_huge_pages = huge_pages_off; // what the last allocate_lines got
+
+const size_t huge_page_size = 2 * 1024 * 1024;
+
+// Kept in the 128 bytes before each block so free_lines knows how it was allocated
+struct lines_header
+{
+    void *base;
+    size_t mapped; // 0 unless base came from mmap
+};
+
+// Whole 128 byte pairs of cache lines, so nothing else shares them; release with free_lines
+void *allocate_lines(size_t size)
+{
+    size = (size + 127) / 128 * 128 + 128;
+
+    void *base = MAP_FAILED;
+    size_t mapped = 0;
+    last_huge_pages = huge_pages_off;
+    if (huge_pages == huge_pages_hugetlb)
+    {
+        mapped = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        base = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base != MAP_FAILED)
+            last_huge_pages = huge_pages_hugetlb;
+    }
+
+    if (base == MAP_FAILED)
+    {
+        mapped = 0;
+        const bool thp = huge_pages != huge_pages_off;
+        if (thp)
+            size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+        CHECK( posix_memalign(&base, thp ? huge_page_size : 128, size) == 0 );
+        if (thp && madvise(base, size, MADV_HUGEPAGE) == 0)
+            last_huge_pages = huge_pages_thp;
+    }
+
+    lines_header *header = static_cast<lines_header *>(base);
+    header->base = base;
+    header->mapped = mapped;
+    return static_cast<char *>(base) + 128;
+}
+
+void free_lines(void *block)
+{
+    const lines_header &header = *static_cast<const lines_header *>(static_cast<void *>(static_cast<char *>(block) - 128));
+    if (header.mapped != 0)
+        CHECK( munmap(header.base, header.mapped) == 0 );
+    else
+        std::free(header.base);
+}
+
+// dTLB load misses of this thread and of the threads it creates while the counter exists, where perf_event_open
+// is allowed; read once those threads have been joined
+class tlb_miss_counter
+{
+    public:
+        explicit tlb_miss_counter(bool enabled) : enabled(enabled), fd(-1)
+        {
+            if (!enabled)
+                return;
+
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.size = sizeof(attr);
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        ~tlb_miss_counter()
+        {
+            if (fd != -1)
+                close(fd);
+        }
+
+        bool is_enabled() const { return enabled; }
+
+        // Returns false if there is no counter
+        bool read_misses(uint64_t &misses) const
+        {
+            return fd != -1 && read(fd, &misses, sizeof(misses)) == static_cast<ssize_t>(sizeof(misses));
+        }
+
+    private:
+        tlb_miss_counter(const tlb_miss_counter &);
+        tlb_miss_counter &operator=(const tlb_miss_counter &);
+
+        const bool enabled;
+        int fd;
+};
+
+void report_tlb_misses(const tlb_miss_counter &counter, uint64_t acquisitions)
+{
+    uint64_t misses = 0;
+    if (!counter.is_enabled())
+        return;
+    else if (counter.read_misses(misses))
+        std::cout << "    " << misses << " dTLB load misses, " << std::setprecision(3) << (static_cast<double>(misses) / acquisitions)
+                  << " per acquisition\n" << std::setprecision(1);
+    else
+        std::cout << "    dTLB load misses not available (perf_event_open: " << std::strerror(errno) << ")\n";
+}
+
+// Options are given as key=value after the thread count
+struct options
+{
+    options() :
+        plugin(0),
+        mode(mode_lock),
+        timeout_ns(10 * 1000),
+        increments(20 * 1000 * 1000),
+        orders("aaa"),
+        write_percent(10),
+        coroutines(1000),
+        task_grain(0),
+        pin(false),
+        park(0),
+        shards(4),
+        rounds(100),
+        hold_ns(100 * 1000),
+        sockets(0),
+        layout(layout_separate),
+        lines(0),
+        count_tlb_misses(false)
+    {
+    }
+
+    const char *plugin;     // shared object implementing test_mutex_plugin.h
+    benchmark_mode mode;
+    uint64_t timeout_ns;    // given in microseconds
+    uint32_t increments;    // per thread
+    const char *orders;     // C++20 locks: acquire, release and spin ordering, each s(eq_cst), a(cq_rel) or r(elaxed+fence)
+    unsigned write_percent; // stamped: share of operations that write
+    unsigned coroutines;    // async_mutex: coroutines sharing the thread pool
+    uint32_t task_grain;    // C++20 build: if not 0, run the increments as tasks of this many on a work-stealing pool
+    bool pin;               // pin thread t to the t'th allowed CPU
+    const char *park;       // benaphore and mutex2: parking backend, sem (default), futex, cond, eventfd or pipe
+    unsigned shards;        // shards_futex and shards_waitv: shard locks, 1 to max_shards
+    uint32_t rounds;        // inversion: acquisitions by the high priority thread
+    uint64_t hold_ns;       // inversion: how long the low priority thread holds the lock, given in microseconds
+    unsigned sockets;       // if not 0, simulate this many sockets for the NUMA aware locks
+    stuff_layout layout;    // test_mutex: where the lock and the counter go
+    unsigned lines;         // test_mutex: cache lines of protected buffer read and written with the counter, 0 to max_lines
+    bool count_tlb_misses;  // test_mutex: report dTLB misses, set by hugepages=
+};
+
+template<typename Mutex>
+struct shared_stuff
+{
+    shared_stuff(const options &opts) : 
+        increments(opts.increments),
+        mode(opts.mode),
+        timeout_ns(opts.timeout_ns),
+        layout(opts.layout),
+        lines(opts.lines),
+        huge_pages(huge_pages_off),
+        finished(0),
+        block(allocate_lines(buffer_offset(layout, sizeof(Mutex)) + lines * 64)),
+        mtx(*new (block) Mutex),
+        total(*new (static_cast<char *>(block) + counter_offset(layout, sizeof(Mutex))) uint32_t(0)),
+        buffer(static_cast<uint64_t *>(static_cast<void *>(static_cast<char *>(block) + buffer_offset(layout, sizeof(Mutex)))))
+    { 
+        huge_pages = last_huge_pages;
+        std::memset(buffer, 0, lines * 64);
+    }
+
+    ~shared_stuff()
+    {
+        mtx.~Mutex();
+        free_lines(block);
+    }
+
+    // The critical section: the counter and every word of the protected buffer
+    void update()
+    {
+        ++total;
+        for (size_t w = 0; w != lines * words_per_line; ++w)
+            ++buffer[w];
+    }
+
+    // Whether every word of the protected buffer saw every update
+    bool buffer_consistent() const
+    {
+        for (size_t w = 0; w != lines * words_per_line; ++w)
+            if (buffer[w] != total)
+                return false;
+        return true;
+    }
+
+    const uint32_t increments;
+    const benchmark_mode mode;
+    const uint64_t timeout_ns;
+    const stuff_layout layout;
+    const unsigned lines;
+    huge_pages_mode huge_pages; // what block got
+    int32_t finished; // set by the first thread to finish its increments
+
+    void *const block; // holds mtx, total and buffer, placed as layout says
+    Mutex &mtx;
+    uint32_t &total;
+    uint64_t *const buffer; // lines cache lines
+};
+
+struct thread_stats
+{
+    thread_stats() :
+        try_successes(0),
+        timeouts(0),
+        timeout_overshoot(0.0),
+        max_timeout_overshoot(0.0),
+        progress(0)
+    {
+    }
+
+    uint32_t try_successes;         // acquisitions that didn't need the lock() fallback
+    uint32_t timeouts;
+    double timeout_overshoot;       // sum of (time spent in a failed try_lock_for - timeout)
+    double max_timeout_overshoot;
+    uint32_t progress;              // increments done when the first thread finished
+};
+
+template<typename Mutex>
+struct thread_context
+{
+    thread_context(shared_stuff<Mutex> *stuff) : stuff(stuff), index(0) { }
+
+    shared_stuff<Mutex> *stuff;
+    unsigned index;
+    thread_stats stats;
+
+    char cache_line_separation[64]; // keep the stats of different threads off each other's cache lines
+};
+
+template<typename Mutex>
+void acquire(shared_stuff<Mutex> &stuff, thread_stats &stats)
+{
+    switch (stuff.mode)
+    {
+        case mode_lock:
+            stuff.mtx.lock();
+            break;
+
+        case mode_try_lock:
+            if (stuff.mtx.try_lock())
+                ++stats.try_successes;
+            else
+                stuff.mtx.lock();
+            break;
+
+        case mode_timed_lock:
+        {
+            const double start = now_seconds();
+            if (stuff.mtx.try_lock_for(stuff.timeout_ns))
+            {
+                ++stats.try_successes;
+                break;
+            }
+
+            const double overshoot = now_seconds() - start - stuff.timeout_ns * 1e-9;
+            ++stats.timeouts;
+            stats.timeout_overshoot += overshoot;
+            if (overshoot > stats.max_timeout_overshoot)
+                stats.max_timeout_overshoot = overshoot;
+
+            stuff.mtx.lock();
+            break;
+        }
+    }
+}
+
+template<typename Mutex>
+void *thread_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    thread_context<Mutex> &context = *static_cast<thread_context<Mutex> *>(opaque_arg);
+    shared_stuff<Mutex> &stuff = *context.stuff;
+    thread_index = context.index;
+
+    for (uint32_t i = 0; i != stuff.increments; ++i)
+    {
+        acquire(stuff, context.stats);
+        stuff.update();
+        stuff.mtx.unlock();
+
+        if (context.stats.progress == 0 && load(stuff.finished) != 0)
+            context.stats.progress = i + 1;
+    }
+
+    if (context.stats.progress == 0)
+        context.stats.progress = stuff.increments;
+    store(stuff.finished, 1);
+
+    return 0;
+}
+
+// Lock specific statistics printed after the run; most locks have none
+template<typename Mutex>
+void report_lock(const Mutex &)
+{
+}
+
+// How evenly the threads progressed, from their increments when the first thread finished: the least and most as a
+// share of the total, and Jain's fairness index, (sum x)^2 / (n * sum x^2), which is 1 when all are equal
+template<typename Mutex>
+void report_fairness(const shared_stuff<Mutex> &stuff, const std::vector<thread_context<Mutex> > &contexts)
+{
+    if (contexts.size() < 2 || stuff.finished == 0)
+        return;
+
+    uint32_t least = stuff.increments, most = 0;
+    double sum = 0.0, sum_of_squares = 0.0;
+    for (size_t t = 0; t != contexts.size(); ++t)
+    {
+        const uint32_t progress = contexts[t].stats.progress;
+        least = std::min(least, progress);
+        most = std::max(most, progress);
+        sum += progress;
+        sum_of_squares += static_cast<double>(progress) * progress;
+    }
+
+    std::cout << "    when the first thread finished the others had done " << std::setprecision(1)
+              << (100.0 * least / stuff.increments) << "% to " << (100.0 * most / stuff.increments)
+              << "% of their increments, Jain's fairness index " << std::setprecision(3)
+              << (sum_of_squares > 0.0 ? sum * sum / (contexts.size() * sum_of_squares) : 1.0) << '\n' << std::setprecision(1);
+}
+
+template<typename Mutex>
+void report(const char *name, unsigned num_threads, const shared_stuff<Mutex> &stuff,
+            const std::vector<thread_context<Mutex> > &contexts, double elapsed)
+{
+    const uint64_t acquisitions = static_cast<uint64_t>(num_threads) * stuff.increments;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << num_threads << " threads, " << acquisitions << " acquisitions in " << elapsed << " s, "
+              << std::setprecision(1) << (elapsed * 1e9 / acquisitions) << " ns per acquisition\n";
+
+    if (stuff.layout != layout_separate)
+    {
+        const size_t offset = counter_offset(stuff.layout, sizeof(Mutex));
+        std::cout << "    " << layout_names[stuff.layout] << " layout: the counter is " << offset << " bytes after the start of the "
+                  << sizeof(Mutex) << " byte lock" << (offset + sizeof(uint32_t) <= 64 ? ", on the same cache line\n" : "\n");
+    }
+
+    if (huge_pages != huge_pages_off)
+        std::cout << "    shared block on " << (stuff.huge_pages == huge_pages_hugetlb ? "hugetlb pages" :
+                                                stuff.huge_pages == huge_pages_thp ? "memory advised for transparent huge pages" :
+                                                "regular pages (no huge pages available)") << '\n';
+
+    if (stuff.lines != 0)
+        std::cout << "    " << stuff.lines << " protected cache lines read and written per acquisition, "
+                  << (elapsed * 1e9 / acquisitions / stuff.lines) << " ns per line\n";
+
+    report_lock(stuff.mtx);
+    report_fairness(stuff, contexts);
+
+    if (stuff.mode == mode_lock)
+        return;
+
+    thread_stats total;
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        const thread_stats &stats = contexts[t].stats;
+        total.try_successes += stats.try_successes;
+        total.timeouts += stats.timeouts;
+        total.timeout_overshoot += stats.timeout_overshoot;
+        if (stats.max_timeout_overshoot > total.max_timeout_overshoot)
+            total.max_timeout_overshoot = stats.max_timeout_overshoot;
+    }
+
+    std::cout << "    " << (stuff.mode == mode_try_lock ? "try_lock" : "try_lock_for") << " succeeded "
+              << (100.0 * total.try_successes / acquisitions) << "% of the time\n";
+
+    if (stuff.mode == mode_timed_lock && total.timeouts != 0)
+        std::cout << "    " << total.timeouts << " timeouts of " << (stuff.timeout_ns * 1e-3) << " us, returned "
+                  << (total.timeout_overshoot / total.timeouts * 1e6) << " us late on average, "
+                  << (total.max_timeout_overshoot * 1e6) << " us at most\n";
+}
+
+// Thread attributes pinning the thread to the index'th CPU the process may run on (round robin)
+void pin_to_cpu(pthread_attr_t &attr, size_t index)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    CHECK( sched_getaffinity(0, sizeof(allowed), &allowed) == 0 );
+
+    const size_t count = CPU_COUNT(&allowed);
+    if (count == 0)
+        return;
+
+    for (int cpu = 0, seen = 0; cpu != CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed) && static_cast<size_t>(seen++) == index % count)
+        {
+            cpu_set_t pinned;
+            CPU_ZERO(&pinned);
+            CPU_SET(cpu, &pinned);
+            CHECK( pthread_attr_setaffinity_np(&attr, sizeof(pinned), &pinned) == 0 );
+            return;
+        }
+    }
+}
+
+// Runs body on one thread per element of contexts, passing it that element, and returns the elapsed seconds.
+// With pin, thread t only runs on the t'th allowed CPU.
+template<typename Context>
+double run_threads(void *(*body)(void *), std::vector<Context> &contexts, bool pin)
+{
+    std::vector<pthread_t> threads;
+    threads.reserve(contexts.size());
+
+    const double start = now_seconds();
+
+    for (size_t t = 0; t != contexts.size(); ++t)
+    {
+        pthread_attr_t attr;
+        CHECK( pthread_attr_init(&attr) == 0 );
+        if (pin)
+            pin_to_cpu(attr, t);
 
-    for (unsigned t = 0; t != num_threads; ++t)
-    {
         pthread_t id;
-        CHECK( pthread_create(&id, 0, &thread_body<Mutex>, &stuff) == 0 );
+        CHECK( pthread_create(&id, &attr, body, &contexts[t]) == 0 );
+        CHECK( pthread_attr_destroy(&attr) == 0 );
         threads.push_back(id);
     }
 
-    for (unsigned t = 0; t != num_threads; ++t)
+    for (size_t t = 0; t != threads.size(); ++t)
+    {
+        void *retval = 0;
+        CHECK( pthread_join(threads[t], &retval) == 0 );
+    }
+
+    return now_seconds() - start;
+}
+
+#if __cplusplus >= 202002L
+
+// The increments of all threads as tasks of at most opts.task_grain increments on a work-stealing pool
+template<typename Mutex>
+void test_mutex_tasks(const char *name, unsigned num_threads, const options &opts)
+{
+    shared_stuff<Mutex> stuff(opts);
+
+    std::vector<thread_context<Mutex> > contexts(num_threads, thread_context<Mutex>(&stuff));
+    tlb_miss_counter tlb_misses(opts.count_tlb_misses);
+    work_stealing_pool pool(num_threads);
+    const double elapsed = pool.run(static_cast<uint64_t>(num_threads) * stuff.increments, opts.task_grain,
+        [&](unsigned worker, uint64_t increments)
+        {
+            for (uint64_t i = 0; i != increments; ++i)
+            {
+                acquire(stuff, contexts[worker].stats);
+                stuff.update();
+                stuff.mtx.unlock();
+            }
+        });
+
+    CHECK ( stuff.total == (num_threads * stuff.increments) );
+    CHECK ( stuff.buffer_consistent() );
+
+    report(name, num_threads, stuff, contexts, elapsed);
+    report_tlb_misses(tlb_misses, static_cast<uint64_t>(num_threads) * stuff.increments);
+
+    uint64_t tasks = 0, steal_attempts = 0, steals = 0;
+    for (const work_stealing_pool::worker_stats &worker : pool.worker_statistics())
+    {
+        tasks += worker.tasks;
+        steal_attempts += worker.steal_attempts;
+        steals += worker.steals;
+    }
+    std::cout << "    " << tasks << " tasks of up to " << opts.task_grain << " increments, " << steals << " stolen in "
+              << steal_attempts << " steal attempts\n";
+}
+
+#endif // __cplusplus >= 202002L
+
+template<typename Mutex>
+void test_mutex(const char *name, unsigned num_threads, const options &opts)
+{
+#if __cplusplus >= 202002L
+    if (opts.task_grain != 0)
+        return test_mutex_tasks<Mutex>(name, num_threads, opts);
+#endif
+
+    shared_stuff<Mutex> stuff(opts);
+
+    std::vector<thread_context<Mutex> > contexts(num_threads, thread_context<Mutex>(&stuff));
+    for (unsigned t = 0; t != num_threads; ++t)
+        contexts[t].index = t;
+
+    tlb_miss_counter tlb_misses(opts.count_tlb_misses);
+    const double elapsed = run_threads(&thread_body<Mutex>, contexts, opts.pin);
+        
+    CHECK ( stuff.total == (num_threads * stuff.increments) );
+    CHECK ( stuff.buffer_consistent() );
+
+    report(name, num_threads, stuff, contexts, elapsed);
+    report_tlb_misses(tlb_misses, static_cast<uint64_t>(num_threads) * stuff.increments);
+}
+
+// Per-CPU alternatives to the mutex protected counter: a counter and a freelist sharded by CPU, updated either
+// with atomics or, where the kernel and glibc provide restartable sequences, with plain per-CPU instructions.
+
+unsigned cpu_shards()
+{
+    static const unsigned shards = static_cast<unsigned>(sysconf(_SC_NPROCESSORS_CONF));
+    return shards;
+}
+
+unsigned current_shard() { return static_cast<unsigned>(sched_getcpu()) % cpu_shards(); }
+
+struct freelist_node
+{
+    freelist_node() : next(0), next_index(0), uses(0) { }
+
+    freelist_node *next;    // freelist_rseq
+    uint32_t next_index;    // freelist_sharded
+    uint32_t uses;          // written only by the thread that popped the node
+
+    char cache_line_separation[48]; // one node per cache line
+};
+
+#if defined(HAVE_RSEQ)
+
+// The calling thread's rseq area: glibc's registration, or one registered here if glibc didn't register
+// (e.g. GLIBC_TUNABLES=glibc.pthread.rseq=0). Returns 0 when the kernel refuses.
+struct rseq *rseq_area()
+{
+    if (__rseq_size != 0)
+        return reinterpret_cast<struct rseq *>(static_cast<char *>(__builtin_thread_pointer()) + __rseq_offset);
+
+    static __thread struct rseq own;
+    static __thread int registered = 0; // 1 registered, -1 refused
+    if (registered == 0)
+        registered = syscall(SYS_rseq, &own, sizeof(own), 0, RSEQ_SIG) == 0 ? 1 : -1;
+
+    return registered > 0 ? &own : 0;
+}
+
+uint32_t rseq_cpu(const struct rseq *rs) { return *static_cast<const volatile uint32_t *>(&rs->cpu_id_start); }
+
+// Start of an rseq critical section: the descriptor (3) for the section from 1 to the commit at 2 with its
+// abort handler at 4, and the store of that descriptor into the rseq area. Then the check that the thread is
+// still on the CPU it indexed the per-CPU data with.
+#define RSEQ_BEGIN \
+    ".pushsection __rseq_cs, \"aw\"\n\t" \
+    ".balign 32\n\t" \
+    "3:\n\t" \
+    ".long 0x0, 0x0\n\t" \
+    ".quad 1f, (2f - 1f), 4f\n\t" \
+    ".popsection\n\t" \
+    "leaq 3b(%%rip), %[scratch]\n\t" \
+    "movq %[scratch], %[rseq_cs]\n\t" \
+    "1:\n\t" \
+    "cmpl %[cpu], %[cpu_id]\n\t" \
+    "jnz 4f\n\t"
+
+// End of an rseq critical section: the abort handler, preceded by the signature the kernel checks, sets aborted
+#define RSEQ_END \
+    "2:\n\t" \
+    ".pushsection __rseq_failure, \"ax\"\n\t" \
+    ".byte 0x0f, 0xb9, 0x3d\n\t" \
+    ".long 0x53053053\n\t" /* RSEQ_SIG */ \
+    "4:\n\t" \
+    "movl $1, %[aborted]\n\t" \
+    "jmp 2b\n\t" \
+    ".popsection\n\t"
+
+// *counter += value, provided the thread is still on cpu. Returns false if the sequence was aborted.
+bool rseq_add(struct rseq *rs, uint32_t cpu, intptr_t *counter, intptr_t value)
+{
+    int aborted = 0;
+    intptr_t scratch;
+    __asm__ __volatile__(
+        RSEQ_BEGIN
+        "addq %[value], %[counter]\n\t"
+        RSEQ_END
+        : [rseq_cs] "=m" (rs->rseq_cs), [counter] "+m" (*counter), [aborted] "+r" (aborted), [scratch] "=&r" (scratch)
+        : [cpu] "r" (cpu), [cpu_id] "m" (rs->cpu_id), [value] "er" (value)
+        : "memory", "cc");
+    return aborted == 0;
+}
+
+// Pops the first node of *head (0 if empty) into node, provided the thread is still on cpu. Returns false if the
+// sequence was aborted.
+bool rseq_pop(struct rseq *rs, uint32_t cpu, freelist_node **head, freelist_node *&node)
+{
+    int aborted = 0;
+    intptr_t scratch;
+    __asm__ __volatile__(
+        RSEQ_BEGIN
+        "movq %[head], %[node]\n\t"
+        "testq %[node], %[node]\n\t"
+        "jz 2f\n\t"
+        "movq (%[node]), %[scratch]\n\t" // node->next
+        "movq %[scratch], %[head]\n\t"
+        RSEQ_END
+        : [rseq_cs] "=m" (rs->rseq_cs), [head] "+m" (*head), [node] "=&r" (node), [aborted] "+r" (aborted), [scratch] "=&r" (scratch)
+        : [cpu] "r" (cpu), [cpu_id] "m" (rs->cpu_id)
+        : "memory", "cc");
+    return aborted == 0;
+}
+
+// Pushes node onto *head, provided the thread is still on cpu. Returns false if the sequence was aborted.
+bool rseq_push(struct rseq *rs, uint32_t cpu, freelist_node **head, freelist_node *node)
+{
+    int aborted = 0;
+    intptr_t scratch;
+    __asm__ __volatile__(
+        RSEQ_BEGIN
+        "movq %[head], %[scratch]\n\t"
+        "movq %[scratch], (%[node])\n\t" // node->next
+        "movq %[node], %[head]\n\t"
+        RSEQ_END
+        : [rseq_cs] "=m" (rs->rseq_cs), [head] "+m" (*head), [aborted] "+r" (aborted), [scratch] "=&r" (scratch)
+        : [cpu] "r" (cpu), [cpu_id] "m" (rs->cpu_id), [node] "r" (node)
+        : "memory", "cc");
+    return aborted == 0;
+}
+
+#undef RSEQ_BEGIN
+#undef RSEQ_END
+
+#else
+
+struct rseq;
+struct rseq *rseq_area() { return 0; }
+
+#endif // HAVE_RSEQ
+
+// Counter sharded by CPU, with an atomic add on the shard of the CPU the thread happens to be on
+class counter_sharded
+{
+    public:
+        counter_sharded() : shards(cpu_shards()) { }
+
+        // Returns the number of retries, always 0 here
+        unsigned add(intptr_t value)
+        {
+            __sync_fetch_and_add(&shards[current_shard()].value, value);
+            return 0;
+        }
+
+        intptr_t sum() const
+        {
+            intptr_t total = 0;
+            for (size_t s = 0; s != shards.size(); ++s)
+                total += shards[s].value;
+            return total;
+        }
+
+        static const char *implementation() { return "atomic add on the current CPU's shard"; }
+
+    protected:
+        struct shard
+        {
+            shard() : value(0) { }
+
+            intptr_t value;
+            char cache_line_separation[56];
+        };
+
+        std::vector<shard> shards;
+};
+
+// Counter sharded by CPU, with a plain add in an rseq critical section. Uses counter_sharded when the main
+// thread can't register rseq; atomic and non-atomic adds can't be mixed on the same shard.
+class counter_rseq : public counter_sharded
+{
+    public:
+        counter_rseq() : use_rseq(rseq_area() != 0) { }
+
+        // Returns the number of aborted critical sections
+        unsigned add(intptr_t value)
+        {
+            if (!use_rseq)
+                return counter_sharded::add(value);
+
+#if defined(HAVE_RSEQ)
+            struct rseq *rs = rseq_area();
+            CHECK( rs != 0 );
+
+            for (unsigned aborts = 0; ; ++aborts)
+            {
+                const uint32_t cpu = rseq_cpu(rs);
+                CHECK( cpu < shards.size() );
+                if (rseq_add(rs, cpu, &shards[cpu].value, value))
+                    return aborts;
+            }
+#endif
+            return 0;
+        }
+
+        const char *implementation() const { return use_rseq ? "rseq add on the current CPU's shard" : "rseq unavailable, atomic add on the current CPU's shard"; }
+
+    private:
+        const bool use_rseq;
+};
+
+// Freelist sharded by CPU: a Treiber stack per CPU whose head packs a node index with an ABA tag
+class freelist_sharded
+{
+    public:
+        freelist_sharded(std::vector<freelist_node> &nodes) : nodes(nodes), heads(cpu_shards())
+        {
+            for (uint32_t n = 0; n != nodes.size(); ++n)
+            {
+                head &h = heads[n % heads.size()];
+                nodes[n].next_index = static_cast<uint32_t>(h.tagged);
+                h.tagged = n;
+            }
+        }
+
+        // Returns 0 if the current CPU's list is empty; retries counts failed CAS attempts
+        freelist_node *pop(uint64_t &retries)
+        {
+            uint64_t &tagged = heads[current_shard()].tagged;
+            for (;;)
+            {
+                const uint64_t current = *static_cast<volatile uint64_t *>(&tagged);
+                const uint32_t index = static_cast<uint32_t>(current);
+                if (index == empty)
+                    return 0;
+
+                const uint64_t next = ((current >> 32) + 1) << 32 | *static_cast<volatile uint32_t *>(&nodes[index].next_index);
+                if (__sync_bool_compare_and_swap(&tagged, current, next))
+                    return &nodes[index];
+
+                ++retries;
+            }
+        }
+
+        void push(freelist_node *node, uint64_t &retries)
+        {
+            const uint32_t index = static_cast<uint32_t>(node - &nodes[0]);
+            uint64_t &tagged = heads[current_shard()].tagged;
+            for (;;)
+            {
+                const uint64_t current = *static_cast<volatile uint64_t *>(&tagged);
+                node->next_index = static_cast<uint32_t>(current);
+                if (__sync_bool_compare_and_swap(&tagged, current, ((current >> 32) + 1) << 32 | index))
+                    return;
+
+                ++retries;
+            }
+        }
+
+        static const char *implementation() { return "CAS on the current CPU's tagged list head"; }
+
+    private:
+        static const uint32_t empty = 0xffffffff;
+
+        struct head
+        {
+            head() : tagged(empty) { }
+
+            uint64_t tagged; // ABA tag << 32 | index of the first node
+            char cache_line_separation[56];
+        };
+
+        std::vector<freelist_node> &nodes;
+        std::vector<head> heads;
+};
+
+// Freelist sharded by CPU, with the list operations as rseq critical sections. Uses freelist_sharded when
+// the main thread can't register rseq.
+class freelist_rseq
+{
+    public:
+        freelist_rseq(std::vector<freelist_node> &nodes) :
+            use_rseq(rseq_area() != 0),
+            heads(cpu_shards()),
+            fallback(nodes)
+        {
+            for (size_t n = 0; n != nodes.size(); ++n)
+            {
+                head &h = heads[n % heads.size()];
+                nodes[n].next = h.first;
+                h.first = &nodes[n];
+            }
+        }
+
+        // Returns 0 if the current CPU's list is empty; retries counts aborted critical sections
+        freelist_node *pop(uint64_t &retries)
+        {
+            if (!use_rseq)
+                return fallback.pop(retries);
+
+#if defined(HAVE_RSEQ)
+            struct rseq *rs = rseq_area();
+            CHECK( rs != 0 );
+
+            for (;;)
+            {
+                const uint32_t cpu = rseq_cpu(rs);
+                CHECK( cpu < heads.size() );
+                freelist_node *node;
+                if (rseq_pop(rs, cpu, &heads[cpu].first, node))
+                    return node;
+
+                ++retries;
+            }
+#endif
+            return 0;
+        }
+
+        void push(freelist_node *node, uint64_t &retries)
+        {
+            if (!use_rseq)
+                return fallback.push(node, retries);
+
+#if defined(HAVE_RSEQ)
+            struct rseq *rs = rseq_area();
+            CHECK( rs != 0 );
+
+            for (;;)
+            {
+                const uint32_t cpu = rseq_cpu(rs);
+                CHECK( cpu < heads.size() );
+                if (rseq_push(rs, cpu, &heads[cpu].first, node))
+                    return;
+
+                ++retries;
+            }
+#endif
+        }
+
+        const char *implementation() const { return use_rseq ? "rseq on the current CPU's list head" : "rseq unavailable, CAS on the current CPU's tagged list head"; }
+
+    private:
+        struct head
+        {
+            head() : first(0) { }
+
+            freelist_node *first;
+            char cache_line_separation[56];
+        };
+
+        const bool use_rseq;
+        std::vector<head> heads;
+        freelist_sharded fallback;
+};
+
+template<typename PerCpu>
+struct percpu_context
+{
+    percpu_context(PerCpu *shared, uint32_t increments) : shared(shared), increments(increments), retries(0), empty(0) { }
+
+    PerCpu *shared;
+    uint32_t increments;
+    uint64_t retries;   // aborted critical sections or failed CAS attempts
+    uint64_t empty;     // pops that found the current CPU's list empty
+
+    char cache_line_separation[64];
+};
+
+template<typename Counter>
+void *counter_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    percpu_context<Counter> &context = *static_cast<percpu_context<Counter> *>(opaque_arg);
+
+    for (uint32_t i = 0; i != context.increments; ++i)
+        context.retries += context.shared->add(1);
+
+    return 0;
+}
+
+// Each increment pops a node, bumps its use count and pushes it back
+template<typename Freelist>
+void *freelist_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    percpu_context<Freelist> &context = *static_cast<percpu_context<Freelist> *>(opaque_arg);
+
+    for (uint32_t i = 0; i != context.increments; ++i)
+    {
+        freelist_node *node;
+        while ((node = context.shared->pop(context.retries)) == 0)
+        {
+            ++context.empty; // the nodes have migrated to other CPUs' lists
+            sched_yield();
+        }
+
+        ++node->uses;
+        context.shared->push(node, context.retries);
+    }
+
+    return 0;
+}
+
+template<typename PerCpu>
+void report_percpu(const char *name, const char *implementation, const std::vector<percpu_context<PerCpu> > &contexts, double elapsed)
+{
+    uint64_t operations = 0, retries = 0, empty = 0;
+    for (size_t t = 0; t != contexts.size(); ++t)
+    {
+        operations += contexts[t].increments;
+        retries += contexts[t].retries;
+        empty += contexts[t].empty;
+    }
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << contexts.size() << " threads, " << operations << " increments in " << elapsed << " s, "
+              << std::setprecision(1) << (elapsed * 1e9 / operations) << " ns per increment\n"
+              << "    " << implementation << ", " << retries << " retries";
+    if (empty != 0)
+        std::cout << ", " << empty << " pops found the CPU's list empty";
+    std::cout << '\n';
+}
+
+template<typename Counter>
+void test_counter(const char *name, unsigned num_threads, const options &opts)
+{
+    Counter counter;
+
+    std::vector<percpu_context<Counter> > contexts(num_threads, percpu_context<Counter>(&counter, opts.increments));
+    const double elapsed = run_threads(&counter_body<Counter>, contexts, opts.pin);
+
+    CHECK( counter.sum() == static_cast<intptr_t>(num_threads) * opts.increments );
+
+    report_percpu(name, counter.implementation(), contexts, elapsed);
+}
+
+template<typename Freelist>
+void test_freelist(const char *name, unsigned num_threads, const options &opts)
+{
+    std::vector<freelist_node> nodes(cpu_shards() * num_threads); // enough for every thread on any one CPU
+    Freelist freelist(nodes);
+
+    std::vector<percpu_context<Freelist> > contexts(num_threads, percpu_context<Freelist>(&freelist, opts.increments));
+    const double elapsed = run_threads(&freelist_body<Freelist>, contexts, opts.pin);
+
+#if defined(DOCHECKS)
+    uint64_t uses = 0;
+    for (size_t n = 0; n != nodes.size(); ++n)
+        uses += nodes[n].uses;
+    CHECK( uses == static_cast<uint64_t>(num_threads) * opts.increments );
+
+    uint64_t retries = 0;
+    std::vector<bool> popped(nodes.size(), false);
+    for (size_t n = 0; n != nodes.size(); ++n)
+    {
+        freelist_node *node = freelist.pop(retries); // every node is back on some CPU's list, but this thread only sees its own CPU's
+        if (node == 0)
+            break;
+        CHECK( !popped[node - &nodes[0]] );
+        popped[node - &nodes[0]] = true;
+    }
+#endif
+
+    report_percpu(name, freelist.implementation(), contexts, elapsed);
+}
+
+// Optimistic reads: each operation either writes a pair of values under the write lock, or reads them with an
+// optimistic read that falls back to the read lock when validation fails
+struct stamped_stuff
+{
+    stamped_stuff(const options &opts) : increments(opts.increments), write_percent(opts.write_percent), first(0), second(0) { }
+
+    const uint32_t increments;
+    const unsigned write_percent;
+
+    char cache_line_separation1[64]; // put the lock on its own cache line
+    stamped_lock lock;
+    char cache_line_separation2[64]; // put the lock on its own cache line
+
+    uint32_t first;  // always equal to second outside the write lock
+    uint32_t second;
+};
+
+struct stamped_context
+{
+    stamped_context(stamped_stuff *stuff) : stuff(stuff), writes(0), optimistic_reads(0), failed_reads(0) { }
+
+    stamped_stuff *stuff;
+    uint32_t writes;
+    uint32_t optimistic_reads;
+    uint32_t failed_reads;
+
+    char cache_line_separation[64];
+};
+
+void *stamped_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    stamped_context &context = *static_cast<stamped_context *>(opaque_arg);
+    stamped_stuff &stuff = *context.stuff;
+    volatile const uint32_t &first = stuff.first, &second = stuff.second;
+
+    for (uint32_t i = 0; i != stuff.increments; ++i)
+    {
+        if (thread_random() % 100 < stuff.write_percent)
+        {
+            stuff.lock.lock();
+            ++stuff.first;
+            ++stuff.second;
+            stuff.lock.unlock();
+            ++context.writes;
+            continue;
+        }
+
+        ++context.optimistic_reads;
+        const uint32_t stamp = stuff.lock.try_optimistic_read();
+        const uint32_t seen_first = first, seen_second = second;
+        if (stuff.lock.validate(stamp))
+        {
+            CHECK( seen_first == seen_second );
+            continue;
+        }
+
+        ++context.failed_reads;
+        stuff.lock.lock_shared();
+        CHECK( first == second );
+        stuff.lock.unlock_shared();
+    }
+
+    return 0;
+}
+
+void test_stamped(const char *name, unsigned num_threads, const options &opts)
+{
+    stamped_stuff stuff(opts);
+
+    std::vector<stamped_context> contexts(num_threads, stamped_context(&stuff));
+    const double elapsed = run_threads(&stamped_body, contexts, opts.pin);
+
+    uint64_t writes = 0, optimistic_reads = 0, failed_reads = 0;
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        writes += contexts[t].writes;
+        optimistic_reads += contexts[t].optimistic_reads;
+        failed_reads += contexts[t].failed_reads;
+    }
+
+    CHECK( stuff.first == writes && stuff.second == writes );
+
+    const uint64_t operations = static_cast<uint64_t>(num_threads) * stuff.increments;
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << num_threads << " threads, " << operations << " operations (" << stuff.write_percent
+              << "% writes) in " << elapsed << " s, " << std::setprecision(1) << (elapsed * 1e9 / operations) << " ns per operation\n"
+              << "    " << optimistic_reads << " optimistic reads, " << failed_reads << " failed validation ("
+              << std::setprecision(3) << (optimistic_reads ? 100.0 * failed_reads / optimistic_reads : 0.0) << "%)\n";
+}
+
+// Barriers: every thread waits on the barrier opts.increments times. wait() takes the caller's thread index.
+
+template<typename T>
+struct padded_value
+{
+    T value;
+    char cache_line_separation[64];
+};
+
+struct padded_flag
+{
+    padded_flag() : value(0) { }
+
+    int32_t value;
+    char cache_line_separation[60];
+};
+
+// Sense-reversing centralized barrier: the last thread to decrement the count resets it and flips the sense
+class barrier_central
+{
+    public:
+        barrier_central(unsigned num_threads) : num_threads(num_threads), count(num_threads), local_sense(num_threads) { }
+
+        void wait(unsigned thread)
+        {
+            const int32_t sense = local_sense[thread].value = !local_sense[thread].value;
+            if (__sync_fetch_and_sub(&count, 1) == 1)
+            {
+                count = num_threads;
+                store(global_sense.value, sense);
+            }
+            else
+                wait_until_equal(global_sense.value, sense);
+        }
+
+    private:
+        const int32_t num_threads;
+        int32_t count;
+        padded_flag global_sense;
+        std::vector<padded_flag> local_sense;
+};
+
+// Dissemination barrier: in round r thread t signals thread t + 2^r and waits for thread t - 2^r, so after
+// ceil(log2 N) rounds every thread has heard from every other. Flags alternate by parity between episodes.
+class barrier_dissemination
+{
+    public:
+        barrier_dissemination(unsigned num_threads) : num_threads(num_threads), rounds(0), state(num_threads)
+        {
+            while ((1u << rounds) < num_threads)
+                ++rounds;
+
+            flags.resize(num_threads * 2 * rounds);
+        }
+
+        void wait(unsigned thread)
+        {
+            local &mine = state[thread];
+            for (unsigned r = 0; r != rounds; ++r)
+            {
+                store(flag((thread + (1u << r)) % num_threads, mine.parity, r), mine.sense);
+                wait_until_equal(flag(thread, mine.parity, r), mine.sense);
+            }
+
+            if (mine.parity == 1)
+                mine.sense = !mine.sense;
+            mine.parity = 1 - mine.parity;
+        }
+
+    private:
+        struct local
+        {
+            local() : parity(0), sense(1) { }
+
+            int32_t parity;
+            int32_t sense;
+            char cache_line_separation[56];
+        };
+
+        int32_t &flag(unsigned thread, int32_t parity, unsigned round) { return flags[(thread * 2 + parity) * rounds + round].value; }
+
+        const unsigned num_threads;
+        unsigned rounds;
+        std::vector<padded_flag> flags;
+        std::vector<local> state;
+};
+
+// Tournament barrier: in round r the thread t with t % 2^(r+1) == 2^r loses to thread t - 2^r, signals its
+// arrival and waits to be woken; thread 0 wins every round, then each winner wakes the threads it beat.
+class barrier_tournament
+{
+    public:
+        barrier_tournament(unsigned num_threads) : num_threads(num_threads), rounds(0), local_sense(num_threads), wakeup(num_threads)
+        {
+            while ((1u << rounds) < num_threads)
+                ++rounds;
+
+            arrived.resize(num_threads * rounds);
+        }
+
+        void wait(unsigned thread)
+        {
+            const int32_t sense = local_sense[thread].value = !local_sense[thread].value;
+
+            unsigned won = 0; // rounds won, whose losers this thread wakes
+            for (; won != rounds; ++won)
+            {
+                const unsigned distance = 1u << won;
+                if (thread % (2 * distance) != 0)
+                {
+                    store(arrival(thread - distance, won), sense);
+                    wait_until_equal(wakeup[thread].value, sense);
+                    break;
+                }
+
+                if (thread + distance < num_threads)
+                    wait_until_equal(arrival(thread, won), sense);
+            }
+
+            while (won-- != 0)
+            {
+                const unsigned loser = thread + (1u << won);
+                if (loser < num_threads)
+                    store(wakeup[loser].value, sense);
+            }
+        }
+
+    private:
+        int32_t &arrival(unsigned winner, unsigned round) { return arrived[winner * rounds + round].value; }
+
+        const unsigned num_threads;
+        unsigned rounds;
+        std::vector<padded_flag> local_sense;
+        std::vector<padded_flag> arrived;
+        std::vector<padded_flag> wakeup;
+};
+
+class barrier_pthread
+{
+    public:
+        barrier_pthread(unsigned num_threads) { CHECK( pthread_barrier_init(&barrier, 0, num_threads) == 0 ); }
+        ~barrier_pthread() { CHECK( pthread_barrier_destroy(&barrier) == 0 ); }
+
+        void wait(unsigned)
+        {
+            const int result = pthread_barrier_wait(&barrier);
+            CHECK( result == 0 || result == PTHREAD_BARRIER_SERIAL_THREAD );
+        }
+
+    private:
+        pthread_barrier_t barrier;
+};
+
+template<typename Barrier>
+struct barrier_context
+{
+    barrier_context(Barrier *barrier, std::vector<padded_flag> *episodes, uint32_t increments) :
+        barrier(barrier), episodes(episodes), increments(increments), thread(0)
+    {
+    }
+
+    Barrier *barrier;
+    std::vector<padded_flag> *episodes; // per thread, for checking that nobody gets ahead of a barrier
+    uint32_t increments;
+    unsigned thread;
+
+    char cache_line_separation[64];
+};
+
+template<typename Barrier>
+void *barrier_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    barrier_context<Barrier> &context = *static_cast<barrier_context<Barrier> *>(opaque_arg);
+
+    for (uint32_t i = 0; i != context.increments; ++i)
+    {
+#if defined(DOCHECKS)
+        std::vector<padded_flag> &episodes = *context.episodes;
+        store(episodes[context.thread].value, i + 1);
+        context.barrier->wait(context.thread);
+        for (size_t t = 0; t != episodes.size(); ++t)
+            CHECK( load(episodes[t].value) >= static_cast<int32_t>(i + 1) );
+        context.barrier->wait(context.thread); // nobody starts the next episode while others still check this one
+#else
+        context.barrier->wait(context.thread);
+#endif
+    }
+
+    return 0;
+}
+
+template<typename Barrier>
+void test_barrier(const char *name, unsigned num_threads, const options &opts)
+{
+    Barrier barrier(num_threads);
+    std::vector<padded_flag> episodes(num_threads);
+
+    std::vector<barrier_context<Barrier> > contexts(num_threads, barrier_context<Barrier>(&barrier, &episodes, opts.increments));
+    for (unsigned t = 0; t != num_threads; ++t)
+        contexts[t].thread = t;
+
+    const double elapsed = run_threads(&barrier_body<Barrier>, contexts, opts.pin);
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << num_threads << " threads" << (opts.pin ? " (pinned)" : "") << ", " << opts.increments
+              << " episodes in " << elapsed << " s, " << std::setprecision(1) << (elapsed * 1e9 / opts.increments) << " ns per episode\n";
+}
+
+// Eventcount: lets a thread that found nothing to do block until another thread makes progress, without lost
+// wakeups and without the notifier paying for a syscall when nobody waits. A waiter calls prepare_wait(),
+// re-checks its condition, then either cancel_wait() or commit_wait(key); a notifier changes the condition first
+// and then calls notify_one() or notify_all().
+class eventcount
+{
+    public:
+        eventcount() : epoch(0), waiters(0) { }
+
+        uint32_t prepare_wait()
+        {
+            __sync_fetch_and_add(&waiters, 1); // full barrier: the waiter count is visible before the condition is re-checked
+            return *static_cast<volatile uint32_t *>(&epoch);
+        }
+
+        void cancel_wait() { __sync_fetch_and_sub(&waiters, 1); }
+
+        // Returns once a notify happened after the prepare_wait() that returned key
+        void commit_wait(uint32_t key)
+        {
+            while (*static_cast<volatile uint32_t *>(&epoch) == key)
+                futex_wait(&epoch, key);
+
+            __sync_fetch_and_sub(&waiters, 1);
+        }
+
+        void notify_one() { notify(1); }
+        void notify_all() { notify(0x7fffffff); }
+
+    private:
+        void notify(int count)
+        {
+            __sync_synchronize(); // the condition change is visible before the waiter count is read
+            if (load(waiters) == 0)
+                return;
+
+            __sync_fetch_and_add(&epoch, 1);
+            futex_wake(&epoch, count);
+        }
+
+        uint32_t epoch; // futex word, bumped by every notify that finds waiters
+        int32_t waiters;
+};
+
+// Notification benchmarks: a token counter signalled through an eventcount versus a sem_t, which is how
+// benaphore::unlock wakes a waiter
+
+class eventcount_signal
+{
+    public:
+        eventcount_signal() : tokens(0) { }
+
+        void post()
+        {
+            __sync_fetch_and_add(&tokens, 1);
+            events.notify_one();
+        }
+
+        void wait()
+        {
+            while (!try_take())
+            {
+                const uint32_t key = events.prepare_wait();
+                if (try_take())
+                {
+                    events.cancel_wait();
+                    return;
+                }
+
+                events.commit_wait(key);
+            }
+        }
+
+    private:
+        bool try_take()
+        {
+            for (int32_t current = load(tokens); current > 0; current = load(tokens))
+            {
+                if (__sync_bool_compare_and_swap(&tokens, current, current - 1))
+                    return true;
+            }
+
+            return false;
+        }
+
+        int32_t tokens;
+        eventcount events;
+};
+
+// Thread t of a ring waits for its signal and passes it on to thread t + 1, timing each post
+template<typename Signal>
+struct ring_context
+{
+    ring_context() : signals(0), thread(0), num_threads(0), rounds(0), posts(0), post_seconds(0.0) { }
+
+    padded_value<Signal> *signals; // one per thread
+    unsigned thread;
+    unsigned num_threads;
+    uint32_t rounds;
+
+    uint64_t posts;
+    double post_seconds;
+
+    char cache_line_separation[64];
+};
+
+template<typename Signal>
+void *ring_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    ring_context<Signal> &context = *static_cast<ring_context<Signal> *>(opaque_arg);
+    padded_value<Signal> *signals = context.signals;
+    Signal &next = signals[(context.thread + 1) % context.num_threads].value;
+
+    for (uint32_t round = 0; round != context.rounds; ++round)
+    {
+        if (context.thread != 0 || round != 0)
+            signals[context.thread].value.wait();
+
+        const double start = now_seconds();
+        next.post();
+        context.post_seconds += now_seconds() - start;
+        ++context.posts;
+    }
+
+    if (context.thread == 0)
+        signals[0].value.wait(); // the last hand-off of the ring
+
+    return 0;
+}
+
+template<typename Signal>
+void test_notify(const char *name, unsigned num_threads, const options &opts)
+{
+    // Posting with nobody waiting
+    double unwaited;
+    {
+        Signal signal;
+        const double start = now_seconds();
+        for (uint32_t i = 0; i != opts.increments; ++i)
+            signal.post();
+        unwaited = (now_seconds() - start) * 1e9 / opts.increments;
+
+        for (uint32_t i = 0; i != opts.increments; ++i)
+            signal.wait();
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << name << ": " << unwaited << " ns per post without waiters\n";
+
+    if (num_threads < 2)
+        return;
+
+    // Passing a single token around a ring of threads, so that every post wakes a blocked thread
+    padded_value<Signal> *signals = new padded_value<Signal>[num_threads]; // not copied, unlike vector elements
+    std::vector<ring_context<Signal> > contexts(num_threads);
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        contexts[t].signals = signals;
+        contexts[t].thread = t;
+        contexts[t].num_threads = num_threads;
+        contexts[t].rounds = opts.increments / num_threads;
+    }
+
+    const double elapsed = run_threads(&ring_body<Signal>, contexts, opts.pin);
+    delete[] signals;
+
+    uint64_t posts = 0;
+    double post_seconds = 0.0;
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        posts += contexts[t].posts;
+        post_seconds += contexts[t].post_seconds;
+    }
+
+    std::cout << "    ring of " << num_threads << " threads" << (opts.pin ? " (pinned)" : "") << ": " << (elapsed * 1e9 / posts)
+              << " ns per hand-off, " << (post_seconds * 1e9 / posts) << " ns per post (including the clock reads)\n";
+}
+
+// Lock one of N shards: every operation takes whichever shard is free, trying the thread's home shard first.
+// When all of them are taken it either waits on its home shard alone or, with futex_waitv, on all of them at once.
+
+static const unsigned max_shards = 128; // FUTEX_WAITV_MAX
+
+struct lock_shard
+{
+    lock_shard() : total(0) { }
+
+    futex_lock lock;
+    uint32_t total; // operations done under lock
+
+    char cache_line_separation[64];
+};
+
+bool futex_waitv_supported()
+{
+#ifdef SYS_futex_waitv
+    return syscall(SYS_futex_waitv, 0, 0, 0, 0, CLOCK_MONOTONIC) == 0 || errno != ENOSYS;
+#else
+    return false;
+#endif
+}
+
+// Blocks while every shard is locked and marked as waited on, until an unlock wakes this thread
+void wait_for_any(lock_shard *shards, unsigned num_shards)
+{
+#ifdef SYS_futex_waitv
+    futex_waitv waiters[max_shards];
+    for (unsigned s = 0; s != num_shards; ++s)
+    {
+        waiters[s].val = 2;
+        waiters[s].uaddr = reinterpret_cast<uintptr_t>(shards[s].lock.futex_word());
+        waiters[s].flags = FUTEX_32 | futex_lock::futex_flags();
+        waiters[s].__reserved = 0;
+    }
+
+    syscall(SYS_futex_waitv, waiters, num_shards, 0, 0, CLOCK_MONOTONIC);
+#else
+    (void)shards;
+    (void)num_shards;
+#endif
+}
+
+struct shards_context
+{
+    shards_context() : shards(0), num_shards(0), home(0), increments(0), waitv(false), home_acquisitions(0), waits(0) { }
+
+    lock_shard *shards;
+    unsigned num_shards;
+    unsigned home;
+    uint32_t increments;
+    bool waitv;
+
+    uint64_t home_acquisitions;
+    uint64_t waits; // futex_waitv calls; waits on the home shard are counted by its lock
+
+    char cache_line_separation[64];
+};
+
+// Returns the index of the shard it locked
+unsigned lock_any(shards_context &context)
+{
+    lock_shard *shards = context.shards;
+    for (unsigned i = 0; i != context.num_shards; ++i)
+    {
+        const unsigned s = (context.home + i) % context.num_shards;
+        if (shards[s].lock.try_lock())
+            return s;
+    }
+
+    if (!context.waitv)
+    {
+        shards[context.home].lock.lock();
+        return context.home;
+    }
+
+    for (;;)
+    {
+        // Either takes a shard or leaves all of them marked, so whichever is unlocked first wakes a waiter
+        for (unsigned i = 0; i != context.num_shards; ++i)
+        {
+            const unsigned s = (context.home + i) % context.num_shards;
+            if (shards[s].lock.try_lock_contended())
+                return s;
+        }
+
+        wait_for_any(shards, context.num_shards);
+        ++context.waits;
+    }
+}
+
+void *shards_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    shards_context &context = *static_cast<shards_context *>(opaque_arg);
+
+    for (uint32_t i = 0; i != context.increments; ++i)
+    {
+        const unsigned s = lock_any(context);
+        ++context.shards[s].total;
+        context.shards[s].lock.unlock();
+
+        if (s == context.home)
+            ++context.home_acquisitions;
+    }
+
+    return 0;
+}
+
+void test_shards(const char *name, unsigned num_threads, const options &opts, bool waitv)
+{
+    const bool supported = futex_waitv_supported();
+
+    lock_shard *shards = new lock_shard[opts.shards]; // not copied, unlike vector elements
+    std::vector<shards_context> contexts(num_threads);
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        contexts[t].shards = shards;
+        contexts[t].num_shards = opts.shards;
+        contexts[t].home = t % opts.shards;
+        contexts[t].increments = opts.increments;
+        contexts[t].waitv = waitv && supported;
+    }
+
+    const double elapsed = run_threads(&shards_body, contexts, opts.pin);
+
+    uint64_t total = 0, home_acquisitions = 0, waits = 0;
+    for (unsigned s = 0; s != opts.shards; ++s)
+    {
+        total += shards[s].total;
+        waits += shards[s].lock.futex_waits();
+    }
+    for (unsigned t = 0; t != num_threads; ++t)
+    {
+        home_acquisitions += contexts[t].home_acquisitions;
+        waits += contexts[t].waits;
+    }
+    delete[] shards;
+
+    const uint64_t acquisitions = static_cast<uint64_t>(num_threads) * opts.increments;
+    CHECK( total == acquisitions );
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << num_threads << " threads, " << opts.shards << " shards, " << acquisitions << " acquisitions in "
+              << elapsed << " s, " << std::setprecision(1) << (elapsed * 1e9 / acquisitions) << " ns per acquisition\n"
+              << "    " << (100.0 * home_acquisitions / acquisitions) << "% on the home shard, " << waits << " futex waits\n";
+    if (waitv && !supported)
+        std::cout << "    futex_waitv is not available, so this waited on the home shard only\n";
+}
+
+// A value and the lock protecting it side by side, so that a small value shares the lock's cache line and moves
+// with it on every handoff
+template<typename T, typename Mutex>
+class locked
+{
+    public:
+        locked() : value() { }
+
+        Mutex &mutex() { return mtx; }
+        T &get() { return value; } // only with the lock held
+
+    private:
+        Mutex mtx;
+        T value;
+};
+
+// Payload of the given size whose every word is incremented in the critical section
+template<size_t Bytes>
+struct payload
+{
+    payload() { std::memset(words, 0, sizeof(words)); }
+
+    void update()
+    {
+        for (size_t w = 0; w != Bytes / sizeof(uint64_t); ++w)
+            ++words[w];
+    }
+
+    uint64_t words[Bytes / sizeof(uint64_t)];
+};
+
+// The payload either in a locked<T, Mutex> or on the cache lines after the lock's, like shared_stuff's separate layout
+template<typename T, typename Mutex>
+struct payload_stuff
+{
+    payload_stuff(uint32_t increments, bool colocated) :
+        increments(increments),
+        colocated(colocated),
+        block(allocate_lines(counter_offset(layout_separate, sizeof(Mutex)) + sizeof(T) + sizeof(locked<T, Mutex>)))
     {
-        void *retval = 0;
-        CHECK( pthread_join(threads[t], &retval) == 0 );
+        if (colocated)
+        {
+            locked<T, Mutex> *both = new (block) locked<T, Mutex>;
+            mtx = &both->mutex();
+            value = &both->get();
+        }
+        else
+        {
+            mtx = new (block) Mutex;
+            value = new (static_cast<char *>(block) + counter_offset(layout_separate, sizeof(Mutex))) T;
+        }
     }
-        
-    CHECK ( stuff.total == (num_threads * increments) );
+
+    ~payload_stuff()
+    {
+        if (colocated)
+            static_cast<locked<T, Mutex> *>(block)->~locked();
+        else
+            mtx->~Mutex();
+        free_lines(block);
+    }
+
+    const uint32_t increments;
+    const bool colocated;
+    void *const block;
+    Mutex *mtx;
+    T *value;
+};
+
+template<typename T, typename Mutex>
+struct payload_context
+{
+    payload_context(payload_stuff<T, Mutex> *stuff) : stuff(stuff) { }
+
+    payload_stuff<T, Mutex> *stuff;
+
+    char cache_line_separation[64];
+};
+
+template<typename T, typename Mutex>
+void *payload_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    payload_stuff<T, Mutex> &stuff = *static_cast<payload_context<T, Mutex> *>(opaque_arg)->stuff;
+
+    for (uint32_t i = 0; i != stuff.increments; ++i)
+    {
+        stuff.mtx->lock();
+        stuff.value->update();
+        stuff.mtx->unlock();
+    }
+
+    return 0;
+}
+
+// Returns the seconds per acquisition
+template<size_t Bytes, typename Mutex>
+double run_payload(unsigned num_threads, const options &opts, bool colocated)
+{
+    typedef payload<Bytes> value_type;
+    payload_stuff<value_type, Mutex> stuff(opts.increments, colocated);
+
+    std::vector<payload_context<value_type, Mutex> > contexts(num_threads, payload_context<value_type, Mutex>(&stuff));
+    const double elapsed = run_threads(&payload_body<value_type, Mutex>, contexts, opts.pin);
+
+    for (size_t w = 0; w != Bytes / sizeof(uint64_t); ++w)
+        CHECK( stuff.value->words[w] == static_cast<uint64_t>(num_threads) * opts.increments );
+
+    return elapsed / (static_cast<double>(num_threads) * opts.increments);
+}
+
+template<size_t Bytes, typename Mutex>
+void report_payload(unsigned num_threads, const options &opts)
+{
+    const double colocated = run_payload<Bytes, Mutex>(num_threads, opts, true);
+    const double separate = run_payload<Bytes, Mutex>(num_threads, opts, false);
+
+    std::cout << "    " << std::setw(3) << Bytes << " bytes: " << (colocated * 1e9) << " ns per acquisition with the lock, "
+              << (separate * 1e9) << " ns on separate cache lines (" << (100.0 * (separate - colocated) / separate)
+              << "% saved)\n";
+}
+
+// Critical sections updating payloads of 8 to 256 bytes, embedded in a locked<T, Mutex> and on their own lines
+template<typename Mutex>
+void test_payload(const char *name, unsigned num_threads, const options &opts)
+{
+    std::cout << name << ": " << num_threads << " threads, " << (static_cast<uint64_t>(num_threads) * opts.increments)
+              << " acquisitions per run, lock of " << sizeof(Mutex) << " bytes\n" << std::fixed << std::setprecision(1);
+
+    report_payload<8, Mutex>(num_threads, opts);
+    report_payload<16, Mutex>(num_threads, opts);
+    report_payload<32, Mutex>(num_threads, opts);
+    report_payload<64, Mutex>(num_threads, opts);
+    report_payload<128, Mutex>(num_threads, opts);
+    report_payload<256, Mutex>(num_threads, opts);
+}
+
+// Priority inversion: a low priority thread (SCHED_IDLE) keeps taking the lock and holding it for a while, medium
+// priority threads (SCHED_BATCH) spin without touching it, and a high priority thread (SCHED_OTHER) wakes up every
+// millisecond to take the lock, timing how long that takes. They all share one CPU, so the medium threads keep the
+// lock holder from running. None of this needs privileges, but Linux only boosts the owner of a PTHREAD_PRIO_INHERIT
+// mutex to a waiter's realtime priority, so pi_mutex behaves like mutex here.
+
+template<typename Mutex>
+struct inversion_stuff
+{
+    inversion_stuff(const options &opts) : rounds(opts.rounds), hold_ns(opts.hold_ns), done(0) { }
+
+    const uint32_t rounds;
+    const uint64_t hold_ns;
+
+    char cache_line_separation1[64]; // put the lock on its own cache line
+    Mutex mtx;
+    char cache_line_separation2[64]; // put the lock on its own cache line
+
+    int32_t done; // set once the high priority thread has finished its rounds
+};
+
+enum inversion_role
+{
+    role_low,
+    role_medium,
+    role_high
+};
+
+template<typename Mutex>
+struct inversion_context
+{
+    inversion_context(inversion_stuff<Mutex> *stuff, inversion_role role, double *latencies = 0) :
+        stuff(stuff), role(role), acquisitions(0), latencies(latencies)
+    {
+    }
+
+    inversion_stuff<Mutex> *stuff;
+    inversion_role role;
+    uint64_t acquisitions;
+    double *latencies; // high priority thread: seconds from calling lock() to holding the lock, one per round
+
+    char cache_line_separation[64];
+};
+
+void set_policy(int policy)
+{
+    sched_param param;
+    param.sched_priority = 0;
+    CHECK( pthread_setschedparam(pthread_self(), policy, &param) == 0 );
+}
+
+template<typename Mutex>
+void *inversion_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    inversion_context<Mutex> &context = *static_cast<inversion_context<Mutex> *>(opaque_arg);
+    inversion_stuff<Mutex> &stuff = *context.stuff;
+
+    if (context.role == role_low)
+    {
+        set_policy(SCHED_IDLE);
+        while (load(stuff.done) == 0)
+        {
+            stuff.mtx.lock();
+            ++context.acquisitions;
+            const double until = now_seconds() + stuff.hold_ns * 1e-9;
+            while (now_seconds() < until)
+                cpu_relax();
+            stuff.mtx.unlock();
+        }
+    }
+    else if (context.role == role_medium)
+    {
+        set_policy(SCHED_BATCH);
+        while (load(stuff.done) == 0)
+            cpu_relax();
+    }
+    else
+    {
+        const timespec period = { 0, 1000 * 1000 };
+        for (uint32_t round = 0; round != stuff.rounds; ++round)
+        {
+            nanosleep(&period, 0);
+
+            const double start = now_seconds();
+            stuff.mtx.lock();
+            context.latencies[round] = now_seconds() - start;
+            ++context.acquisitions;
+            stuff.mtx.unlock();
+        }
+
+        store(stuff.done, 1);
+    }
+
+    return 0;
+}
+
+// One low and one high priority thread with num_threads - 2 medium priority threads between them
+template<typename Mutex>
+bool test_inversion(const char *name, unsigned num_threads, const options &opts)
+{
+    if (num_threads < 2)
+        return false;
+
+    // Threads inherit the affinity of the thread creating them, so all of them end up on the first allowed CPU
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    CHECK( sched_getaffinity(0, sizeof(allowed), &allowed) == 0 );
+    int cpu = 0;
+    while (cpu != CPU_SETSIZE - 1 && !CPU_ISSET(cpu, &allowed))
+        ++cpu;
+
+    cpu_set_t shared;
+    CPU_ZERO(&shared);
+    CPU_SET(cpu, &shared);
+    CHECK( sched_setaffinity(0, sizeof(shared), &shared) == 0 );
+
+    inversion_stuff<Mutex> stuff(opts);
+    std::vector<double> latencies(stuff.rounds);
+    std::vector<inversion_context<Mutex> > contexts(1, inversion_context<Mutex>(&stuff, role_low));
+    contexts.resize(num_threads - 1, inversion_context<Mutex>(&stuff, role_medium));
+    contexts.push_back(inversion_context<Mutex>(&stuff, role_high, &latencies[0]));
+
+    const double elapsed = run_threads(&inversion_body<Mutex>, contexts, false);
+    CHECK( sched_setaffinity(0, sizeof(allowed), &allowed) == 0 );
+    CHECK( contexts.back().acquisitions == stuff.rounds );
+
+    std::sort(latencies.begin(), latencies.end());
+
+    double sum = 0.0;
+    for (size_t r = 0; r != latencies.size(); ++r)
+        sum += latencies[r];
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": 1 low, " << (num_threads - 2) << " medium and 1 high priority threads on CPU " << cpu << ", "
+              << stuff.rounds << " high priority acquisitions in " << elapsed << " s\n"
+              << std::setprecision(1)
+              << "    high priority lock latency: " << (sum * 1e6 / latencies.size()) << " us on average, "
+              << (latencies[latencies.size() / 2] * 1e6) << " us median, " << (latencies[latencies.size() * 99 / 100] * 1e6)
+              << " us 99th percentile, " << (latencies.back() * 1e6) << " us at most\n"
+              << "    " << contexts.front().acquisitions << " low priority acquisitions holding the lock for "
+              << (stuff.hold_ns / 1000.0) << " us\n";
+    return true;
+}
+
+#if __cplusplus >= 202002L
+
+// Coroutine started by posting its handle to an executor; destroys itself when it finishes
+struct detached_coroutine
+{
+    struct promise_type
+    {
+        detached_coroutine get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::abort(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+struct async_stuff
+{
+    async_stuff(thread_pool_executor &executor, unsigned coroutines) : mtx(executor), done(coroutines) { }
+
+    char cache_line_separation1[64]; // put the mutex on its own cache line
+    async_mutex mtx;
+    char cache_line_separation2[64]; // put the mutex on its own cache line
+
+    uint64_t total = 0;
+    std::latch done;
+};
+
+detached_coroutine async_body(thread_pool_executor &executor, async_stuff &stuff, uint32_t increments)
+{
+    for (uint32_t i = 0; i != increments; ++i)
+    {
+        co_await stuff.mtx.lock();
+        ++stuff.total;
+        stuff.mtx.unlock();
+
+        if (i % 64 == 63)
+            co_await executor.schedule(); // let the other coroutines on this thread run
+    }
+
+    stuff.done.count_down();
+}
+
+// The increments of num_threads threads spread over opts.coroutines coroutines, run on num_threads threads
+void test_async_mutex(const char *name, unsigned num_threads, const options &opts)
+{
+    const uint64_t increments = static_cast<uint64_t>(num_threads) * opts.increments / opts.coroutines;
+
+    const double start = now_seconds();
+    double elapsed;
+    uint64_t contended, total;
+    {
+        thread_pool_executor executor(num_threads);
+        async_stuff stuff(executor, opts.coroutines);
+
+        for (unsigned c = 0; c != opts.coroutines; ++c)
+            executor.post(async_body(executor, stuff, static_cast<uint32_t>(increments)).handle);
+
+        stuff.done.wait();
+        elapsed = now_seconds() - start;
+        contended = stuff.mtx.contended_acquisitions();
+        total = stuff.total;
+    }
+
+    const uint64_t acquisitions = increments * opts.coroutines;
+    CHECK( total == acquisitions );
+
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": " << opts.coroutines << " coroutines on " << num_threads << " threads, " << acquisitions
+              << " acquisitions in " << elapsed << " s, " << std::setprecision(1) << (elapsed * 1e9 / acquisitions) << " ns per acquisition\n"
+              << "    " << std::setprecision(3) << (100.0 * contended / acquisitions) << "% of acquisitions suspended the coroutine\n";
+}
+
+// Work-stealing deque on its own: thread 0 owns the deque and pushes opts.increments values in batches of 64,
+// popping each batch back, while the other threads keep stealing from it
+struct deque_context
+{
+    chase_lev_deque *deque;
+    std::atomic<bool> *owner_done;
+    uint32_t increments;
+    bool owner;
+
+    uint64_t popped = 0;
+    uint64_t popped_sum = 0;    // of the values, to check that each was taken exactly once
+    uint64_t steal_attempts = 0;
+    uint64_t steals = 0;
+    uint64_t lost_races = 0;
+    uint64_t stolen_sum = 0;
+    double steal_seconds = 0.0; // spent in successful steals
+    double owner_seconds = 0.0;
+
+    char cache_line_separation[64];
+};
+
+void *deque_body(void *opaque_arg)
+{
+    CHECK( opaque_arg != 0 );
+    deque_context &context = *static_cast<deque_context *>(opaque_arg);
+    chase_lev_deque &deque = *context.deque;
+
+    if (context.owner)
+    {
+        const uint32_t batch = 64;
+        const double start = now_seconds();
+        for (uint32_t pushed = 0; pushed != context.increments; )
+        {
+            for (uint32_t b = 0; b != batch && pushed != context.increments; ++b)
+                deque.push(++pushed);
+
+            while (const uint64_t value = deque.pop())
+            {
+                ++context.popped;
+                context.popped_sum += value;
+            }
+        }
+        context.owner_seconds = now_seconds() - start;
+        context.owner_done->store(true, std::memory_order_release);
+        return 0;
+    }
+
+    while (!context.owner_done->load(std::memory_order_acquire))
+    {
+        uint64_t value;
+        const double start = now_seconds();
+        const chase_lev_deque::steal_result result = deque.steal(value);
+        ++context.steal_attempts;
+        if (result == chase_lev_deque::stolen)
+        {
+            context.steal_seconds += now_seconds() - start;
+            ++context.steals;
+            context.stolen_sum += value;
+        }
+        else if (result == chase_lev_deque::lost_race)
+            ++context.lost_races;
+    }
+
+    return 0;
+}
+
+void test_deque(const char *name, unsigned num_threads, const options &opts)
+{
+    chase_lev_deque deque;
+    std::atomic<bool> owner_done{false};
+
+    deque_context prototype;
+    prototype.deque = &deque;
+    prototype.owner_done = &owner_done;
+    prototype.increments = opts.increments;
+    prototype.owner = false;
+
+    std::vector<deque_context> contexts(num_threads, prototype);
+    contexts[0].owner = true;
+    run_threads(&deque_body, contexts, opts.pin);
+
+    deque_context total = prototype;
+    for (const deque_context &context : contexts)
+    {
+        total.popped += context.popped;
+        total.popped_sum += context.popped_sum;
+        total.steal_attempts += context.steal_attempts;
+        total.steals += context.steals;
+        total.lost_races += context.lost_races;
+        total.stolen_sum += context.stolen_sum;
+        total.steal_seconds += context.steal_seconds;
+    }
+
+    CHECK( total.popped + total.steals == opts.increments );
+    CHECK( total.popped_sum + total.stolen_sum == static_cast<uint64_t>(opts.increments) * (opts.increments + 1) / 2 );
+
+    const double owner_seconds = contexts[0].owner_seconds;
+    std::cout << std::fixed << std::setprecision(3)
+              << name << ": owner and " << (num_threads - 1) << " stealers, " << opts.increments << " pushes in " << owner_seconds << " s, "
+              << std::setprecision(1) << (owner_seconds * 1e9 / opts.increments) << " ns per owner push and pop\n"
+              << "    " << total.steals << " stolen (" << std::setprecision(3) << (100.0 * total.steals / opts.increments) << "% of pushes), "
+              << total.steal_attempts << " steal attempts (" << (total.steal_attempts ? 100.0 * total.steals / total.steal_attempts : 0.0)
+              << "% succeeded, " << total.lost_races << " lost races), " << std::setprecision(1)
+              << (total.steals ? total.steal_seconds * 1e9 / total.steals : 0.0) << " ns per successful steal\n";
+}
+
+// Instantiates Lock with the orderings named by the letters of opts.orders
+template<template<ordering, ordering, ordering> class Lock, ordering... Chosen>
+bool test_ordered(const char *name, unsigned num_threads, const options &opts, const char *orders)
+{
+    if constexpr (sizeof...(Chosen) == 3)
+    {
+        if (*orders != '\0')
+            return false;
+
+        const std::string full_name = std::string(name) + " orders=" + opts.orders;
+        test_mutex<Lock<Chosen...> >(full_name.c_str(), num_threads, opts);
+        return true;
+    }
+    else
+    {
+        switch (*orders)
+        {
+            case 's': return test_ordered<Lock, Chosen..., ordering::seq_cst>(name, num_threads, opts, orders + 1);
+            case 'a': return test_ordered<Lock, Chosen..., ordering::acq_rel>(name, num_threads, opts, orders + 1);
+            case 'r': return test_ordered<Lock, Chosen..., ordering::relaxed_fence>(name, num_threads, opts, orders + 1);
+            default: return false;
+        }
+    }
+}
+
+#endif // __cplusplus >= 202002L
+
+// Runs Lock<Parker> for the parking backend named by opts.park; returns false if it isn't one
+template<template<typename> class Lock>
+bool test_parked(const char *name, unsigned num_threads, const options &opts)
+{
+    if (opts.park == 0)
+    {
+        test_mutex<Lock<sem_parker> >(name, num_threads, opts);
+        return true;
+    }
+
+    const std::string full_name = std::string(name) + " park=" + opts.park;
+    if (std::strcmp(opts.park, sem_parker::name()) == 0)
+        test_mutex<Lock<sem_parker> >(full_name.c_str(), num_threads, opts);
+    else if (std::strcmp(opts.park, futex_parker::name()) == 0)
+        test_mutex<Lock<futex_parker> >(full_name.c_str(), num_threads, opts);
+    else if (std::strcmp(opts.park, cond_parker::name()) == 0)
+        test_mutex<Lock<cond_parker> >(full_name.c_str(), num_threads, opts);
+    else if (std::strcmp(opts.park, eventfd_parker::name()) == 0)
+        test_mutex<Lock<eventfd_parker> >(full_name.c_str(), num_threads, opts);
+    else if (std::strcmp(opts.park, pipe_parker::name()) == 0)
+        test_mutex<Lock<pipe_parker> >(full_name.c_str(), num_threads, opts);
+    else
+        return false;
+
+    return true;
+}
+
+// Returns the value if arg is "key=value", otherwise 0
+const char *option_value(const char *arg, const char *key)
+{
+    const size_t length = std::strlen(key);
+    if (std::strncmp(arg, key, length) != 0 || arg[length] != '=')
+        return 0;
+
+    return arg + length + 1;
+}
+
+bool parse_options(int argc, char **argv, options &opts)
+{
+    for (int i = 3; i < argc; ++i)
+    {
+        if (const char *value = option_value(argv[i], "plugin"))
+            opts.plugin = value;
+        else if (const char *value = option_value(argv[i], "mode"))
+        {
+            if (std::strcmp(value, "lock") == 0)
+                opts.mode = mode_lock;
+            else if (std::strcmp(value, "trylock") == 0)
+                opts.mode = mode_try_lock;
+            else if (std::strcmp(value, "timedlock") == 0)
+                opts.mode = mode_timed_lock;
+            else
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "timeout"))
+            opts.timeout_ns = std::strtoul(value, 0, 10) * 1000;
+        else if (const char *value = option_value(argv[i], "pause_spins"))
+            mutex2_backoff::config.pause_spins = std::strtoul(value, 0, 10);
+        else if (const char *value = option_value(argv[i], "max_backoff"))
+        {
+            mutex2_backoff::config.max_backoff = std::strtoul(value, 0, 10);
+            if (mutex2_backoff::config.max_backoff == 0)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "yield_spins"))
+            mutex2_backoff::config.yield_spins = std::strtoul(value, 0, 10);
+        else if (const char *value = option_value(argv[i], "write_pct"))
+        {
+            opts.write_percent = std::strtoul(value, 0, 10);
+            if (opts.write_percent > 100)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "coroutines"))
+        {
+            opts.coroutines = std::strtoul(value, 0, 10);
+            if (opts.coroutines == 0)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "pin"))
+            opts.pin = std::strcmp(value, "1") == 0;
+        else if (const char *value = option_value(argv[i], "tasks"))
+            opts.task_grain = std::strtoul(value, 0, 10);
+        else if (const char *value = option_value(argv[i], "orders"))
+            opts.orders = value;
+        else if (const char *value = option_value(argv[i], "park"))
+            opts.park = value;
+        else if (const char *value = option_value(argv[i], "rounds"))
+        {
+            opts.rounds = std::strtoul(value, 0, 10);
+            if (opts.rounds == 0)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "hold"))
+            opts.hold_ns = std::strtoul(value, 0, 10) * 1000;
+        else if (const char *value = option_value(argv[i], "layout"))
+        {
+            int layout = 0;
+            while (layout != layout_count && std::strcmp(value, layout_names[layout]) != 0)
+                ++layout;
+            if (layout == layout_count)
+                return false;
+            opts.layout = static_cast<stuff_layout>(layout);
+        }
+        else if (const char *value = option_value(argv[i], "hugepages"))
+        {
+            int mode = 0;
+            while (mode != huge_pages_count && std::strcmp(value, huge_pages_names[mode]) != 0)
+                ++mode;
+            if (mode == huge_pages_count)
+                return false;
+            huge_pages = static_cast<huge_pages_mode>(mode);
+            opts.count_tlb_misses = true;
+        }
+        else if (const char *value = option_value(argv[i], "lines"))
+        {
+            opts.lines = std::strtoul(value, 0, 10);
+            if (opts.lines > max_lines)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "sockets"))
+            opts.sockets = std::strtoul(value, 0, 10);
+        else if (const char *value = option_value(argv[i], "max_local"))
+            max_local_handoffs = std::strtoul(value, 0, 10);
+        else if (const char *value = option_value(argv[i], "local_backoff"))
+        {
+            hbo_lock::config.local_backoff = std::strtoul(value, 0, 10);
+            if (hbo_lock::config.local_backoff == 0)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "remote_backoff"))
+        {
+            hbo_lock::config.remote_backoff = std::strtoul(value, 0, 10);
+            if (hbo_lock::config.remote_backoff == 0)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "shards"))
+        {
+            opts.shards = std::strtoul(value, 0, 10);
+            if (opts.shards == 0 || opts.shards > max_shards)
+                return false;
+        }
+        else if (const char *value = option_value(argv[i], "increments"))
+        {
+            opts.increments = std::strtoul(value, 0, 10);
+            if (opts.increments == 0)
+                return false;
+        }
+        else
+            return false;
+    }
+
+    return true;
 }
 
 int main(int argc, char **argv)
 {
-    if (argc != 3) 
+    if (argc < 3) 
         return 1;
     
     unsigned num_threads = std::atoi(argv[2]);
     if (num_threads == 0 || num_threads > 32)
         return 1;
 
+    options opts;
+    if (!parse_options(argc, argv, opts))
+        return 1;
+
+    simulated_sockets = opts.sockets;
+
     if (std::strcmp(argv[1], "benaphore") == 0)
-        test_mutex<benaphore>(num_threads);
+    {
+        if (!test_parked<basic_benaphore>(argv[1], num_threads, opts))
+            return 1;
+    }
     else if (std::strcmp(argv[1], "mutex") == 0)
-        test_mutex<mutex>(num_threads);
+        test_mutex<mutex>(argv[1], num_threads, opts);
     else if (std::strcmp(argv[1], "mutex2") == 0)
-        test_mutex<mutex2>(num_threads);
+    {
+        if (!test_parked<basic_mutex2>(argv[1], num_threads, opts))
+            return 1;
+    }
+    else if (std::strcmp(argv[1], "mutex2_counted") == 0)
+        test_mutex<mutex2_counted>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "mutex2_ttas") == 0)
+        test_mutex<mutex2_ttas>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "mutex_adaptive") == 0)
+        test_mutex<mutex_adaptive>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "mutex2_backoff") == 0)
+        test_mutex<mutex2_backoff>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "hemlock") == 0)
+        test_mutex<hemlock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "clh") == 0)
+        test_mutex<clh_lock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "mcs") == 0)
+        test_mutex<mcs_lock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "shuffle") == 0)
+        test_mutex<shuffle_lock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "hbo") == 0)
+        test_mutex<hbo_lock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "pi_mutex") == 0)
+        test_mutex<pi_mutex>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "futex_lock") == 0)
+        test_mutex<futex_lock>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "futex_lock_shared") == 0)
+        test_mutex<futex_lock_shared>(argv[1], num_threads, opts);
+#if __cplusplus >= 202002L
+    else if (std::strcmp(argv[1], "benaphore_atomic") == 0)
+    {
+        if (!test_ordered<basic_benaphore_atomic>(argv[1], num_threads, opts, opts.orders))
+            return 1;
+    }
+    else if (std::strcmp(argv[1], "mutex2_atomic") == 0)
+    {
+        if (!test_ordered<basic_mutex2_atomic>(argv[1], num_threads, opts, opts.orders))
+            return 1;
+    }
+    else if (std::strcmp(argv[1], "std_mutex") == 0)
+        test_mutex<std_lock<std::mutex> >(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "std_timed_mutex") == 0)
+        test_mutex<std_lock<std::timed_mutex> >(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "std_shared_mutex") == 0)
+        test_mutex<std_lock<std::shared_mutex> >(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "std_binary_semaphore") == 0)
+        test_mutex<std_binary_semaphore>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "benaphore_std_semaphore") == 0)
+        test_mutex<benaphore_std_semaphore>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "async_mutex") == 0)
+        test_async_mutex(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "deque") == 0)
+        test_deque(argv[1], num_threads, opts);
+#endif
+    else if (std::strcmp(argv[1], "counter_sharded") == 0)
+        test_counter<counter_sharded>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "counter_rseq") == 0)
+        test_counter<counter_rseq>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "freelist_sharded") == 0)
+        test_freelist<freelist_sharded>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "freelist_rseq") == 0)
+        test_freelist<freelist_rseq>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "stamped") == 0)
+        test_stamped(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "barrier_central") == 0)
+        test_barrier<barrier_central>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "barrier_dissemination") == 0)
+        test_barrier<barrier_dissemination>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "barrier_tournament") == 0)
+        test_barrier<barrier_tournament>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "barrier_pthread") == 0)
+        test_barrier<barrier_pthread>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "notify_eventcount") == 0)
+        test_notify<eventcount_signal>(argv[1], num_threads, opts);
+    else if (std::strcmp(argv[1], "notify_sem") == 0)
+        test_notify<sem_parker>(argv[1], num_threads, opts);
+    else if (std::strncmp(argv[1], "inversion_", 10) == 0)
+    {
+        const char *lock = argv[1] + 10;
+        bool tested = false;
+        if (std::strcmp(lock, "mutex") == 0)
+            tested = test_inversion<mutex>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "pi_mutex") == 0)
+            tested = test_inversion<pi_mutex>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "benaphore") == 0)
+            tested = test_inversion<benaphore>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "mutex2") == 0)
+            tested = test_inversion<mutex2>(argv[1], num_threads, opts);
+
+        if (!tested)
+            return 1;
+    }
+    else if (std::strncmp(argv[1], "payload_", 8) == 0)
+    {
+        const char *lock = argv[1] + 8;
+        if (std::strcmp(lock, "mutex") == 0)
+            test_payload<mutex>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "benaphore") == 0)
+            test_payload<benaphore>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "mutex2") == 0)
+            test_payload<mutex2>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "futex_lock") == 0)
+            test_payload<futex_lock>(argv[1], num_threads, opts);
+        else if (std::strcmp(lock, "hemlock") == 0)
+            test_payload<hemlock>(argv[1], num_threads, opts);
+        else
+            return 1;
+    }
+    else if (std::strcmp(argv[1], "shards_futex") == 0)
+        test_shards(argv[1], num_threads, opts, false);
+    else if (std::strcmp(argv[1], "shards_waitv") == 0)
+        test_shards(argv[1], num_threads, opts, true);
+    else if (std::strcmp(argv[1], "plugin") == 0)
+    {
+        if (opts.plugin != 0 && (plugin_mutex::table = load_plugin(opts.plugin)) == 0)
+            return 1;
+
+        report_plugin_overhead();
+        test_mutex<plugin_mutex>(argv[1], num_threads, opts);
+    }
     else
         return 1;
 
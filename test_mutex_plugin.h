@@ -0,0 +1,39 @@
+/*
+ * ABI for lock implementations loaded into test_mutex from a shared object.
+ *
+ * A plugin exports one data symbol, TEST_MUTEX_PLUGIN_SYMBOL, holding a filled in
+ * struct test_mutex_plugin. test_mutex calls create() once per lock, then drives
+ * the lock through lock()/unlock()/try_lock() from every benchmark thread, and
+ * finally calls destroy().
+ *
+ *    gcc my_lock.c -o my_lock.so -shared -fPIC -O3
+ *    test_mutex plugin 4 plugin=./my_lock.so
+ */
+
+#ifndef TEST_MUTEX_PLUGIN_H
+#define TEST_MUTEX_PLUGIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TEST_MUTEX_PLUGIN_ABI_VERSION 1
+#define TEST_MUTEX_PLUGIN_SYMBOL "test_mutex_plugin"
+
+struct test_mutex_plugin
+{
+    unsigned abi_version;              /* must be TEST_MUTEX_PLUGIN_ABI_VERSION */
+    const char *name;                  /* printed in the report */
+
+    void *(*create)(void);             /* returns 0 on failure */
+    void (*destroy)(void *lock);
+    void (*lock)(void *lock);
+    void (*unlock)(void *lock);
+    int (*try_lock)(void *lock);       /* non-zero if the lock was acquired */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TEST_MUTEX_PLUGIN_H */
@@ -0,0 +1,54 @@
+/*
+ * Example test_mutex plugin: a test-and-set spinlock that yields while the lock is held.
+ *
+ *    gcc test_mutex_plugin_example.c -o test_mutex_plugin_example.so -shared -fPIC -O3
+ *    test_mutex plugin 4 plugin=./test_mutex_plugin_example.so
+ */
+
+#include "test_mutex_plugin.h"
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static void *example_create(void)
+{
+    return calloc(1, sizeof(int32_t));
+}
+
+static void example_destroy(void *lock)
+{
+    free(lock);
+}
+
+static void example_lock(void *lock)
+{
+    int32_t *flag = (int32_t *)lock;
+
+    while (__sync_lock_test_and_set(flag, 1) != 0)
+    {
+        while (*(volatile int32_t *)flag != 0)
+            sched_yield();
+    }
+}
+
+static void example_unlock(void *lock)
+{
+    __sync_lock_release((int32_t *)lock);
+}
+
+static int example_try_lock(void *lock)
+{
+    return __sync_lock_test_and_set((int32_t *)lock, 1) == 0;
+}
+
+const struct test_mutex_plugin test_mutex_plugin =
+{
+    TEST_MUTEX_PLUGIN_ABI_VERSION,
+    "example_spinlock",
+    example_create,
+    example_destroy,
+    example_lock,
+    example_unlock,
+    example_try_lock
+};